@@ -16,7 +16,6 @@ unix {
     diff.files = qml/*.diff
 }
 
-LIBS += -lmodbus
 QT += core network dbus
 QT -= gui
 
@@ -26,7 +25,7 @@ CONFIG += console
 CONFIG -= app_bundle
 DEFINES += VERSION=\\\"$${VERSION}\\\"
 
-PKGCONFIG += dbus-1 libmodbus
+PKGCONFIG += dbus-1
 CONFIG += link_pkgconfig
 
 include(ext/qslog/QsLog.pri)
@@ -37,11 +36,31 @@ INCLUDEPATH += \
                src
 
 # Input
-HEADERS += src/dbus_tsmppt.h \
+HEADERS += src/adaptive_poll_policy.h \
+           src/circuit_breaker.h \
+           src/dbus_tsmppt.h \
            src/dbus_bridge.h \
            src/dbus_tsmppt_bridge.h \
+           src/host_resolver.h \
+           src/modbus_gateway.h \
+           src/modbus_tcp_client.h \
+           src/modbus_unit.h \
+           src/process_stats.h \
+           src/publish_policy.h \
+           src/reconnect_backoff.h \
+           src/register_planner.h \
+           src/register_scheduler.h \
+           src/rtt_estimator.h \
+           src/settings_startup.h \
+           src/snapshot_slot.h \
+           src/tsmppt_registers.h \
            src/tsmppt.h \
+           src/tsmppt_acquisition.h \
+           src/tsmppt_cache.h \
+           src/v_bus_item_store.h \
+           src/v_bus_libdbus_store.h \
            src/v_bus_node.h \
+           src/v_bus_path_index.h \
            src/velib/src/qt/v_busitem_adaptor.h \
            src/velib/src/qt/v_busitem_private_cons.h \
            src/velib/src/qt/v_busitem_private_prod.h \
@@ -51,11 +70,29 @@ HEADERS += src/dbus_tsmppt.h \
            src/velib/inc/velib/qt/v_busitems.h
 
 SOURCES += src/tsmppt.cpp \
+           src/tsmppt_acquisition.cpp \
+           src/tsmppt_cache.cpp \
+           src/host_resolver.cpp \
+           src/modbus_gateway.cpp \
+           src/modbus_tcp_client.cpp \
+           src/modbus_unit.cpp \
+           src/process_stats.cpp \
+           src/publish_policy.cpp \
+           src/reconnect_backoff.cpp \
+           src/circuit_breaker.cpp \
+           src/adaptive_poll_policy.cpp \
+           src/register_planner.cpp \
+           src/register_scheduler.cpp \
+           src/rtt_estimator.cpp \
+           src/settings_startup.cpp \
            src/dbus_tsmppt.cpp \
            src/dbus_tsmppt_bridge.cpp \
            src/dbus_bridge.cpp \
            src/main.cpp \
+           src/v_bus_item_store.cpp \
+           src/v_bus_libdbus_store.cpp \
            src/v_bus_node.cpp \
+           src/v_bus_path_index.cpp \
            src/velib/src/qt/v_busitem.cpp \
            src/velib/src/qt/v_busitems.cpp \
            src/velib/src/qt/v_busitem_adaptor.cpp \
@@ -63,6 +100,12 @@ SOURCES += src/tsmppt.cpp \
            src/velib/src/qt/v_busitem_private_prod.cpp \
            src/velib/src/qt/v_busitem_proxy.cpp
 
+# QDBusVirtualObject is available since Qt 5.1
+greaterThan(QT_MAJOR_VERSION, 4) {
+    HEADERS += src/v_bus_virtual_object_store.h
+    SOURCES += src/v_bus_virtual_object_store.cpp
+    DEFINES += VBUS_VIRTUAL_OBJECT_STORE
+}
 
 QMAKE_CXXFLAGS += --std=c++11
 
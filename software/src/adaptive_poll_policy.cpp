@@ -0,0 +1,101 @@
+#include <math.h>
+#include <QtGlobal>
+#include "adaptive_poll_policy.h"
+
+const int CS_DISCONNECT     = 2;
+const int CS_NIGHT          = 3;
+
+const int MIN_BURST_INTERVAL_MS = 1000;
+const int MAX_IDLE_INTERVAL_MS  = 60000;
+// Relative change between two polls considered fast
+const double CHANGE_THRESHOLD   = 0.05;
+// Consecutive polls without fast changes before a burst ends
+const int SETTLE_POLLS          = 3;
+// A burst never lasts longer than this number of polls
+const int MAX_BURST_POLLS       = 30;
+
+AdaptivePollPolicy::AdaptivePollPolicy(int baseIntervalMs):
+    mBaseInterval(baseIntervalMs),
+    mInterval(baseIntervalMs),
+    mHasPrevious(false),
+    mLastState(0),
+    mLastArrayVoltage(0),
+    mLastOutputPower(0),
+    mBurst(false),
+    mBurstPolls(0),
+    mQuietPolls(0)
+{
+}
+
+void AdaptivePollPolicy::setBaseInterval(int ms)
+{
+    mBaseInterval = ms;
+    mInterval = ms;
+    mBurst = false;
+}
+
+int AdaptivePollPolicy::baseInterval() const
+{
+    return mBaseInterval;
+}
+
+int AdaptivePollPolicy::burstInterval() const
+{
+    return qMin(mBaseInterval, qMax(MIN_BURST_INTERVAL_MS, mBaseInterval / 4));
+}
+
+int AdaptivePollPolicy::maxIdleInterval() const
+{
+    return qMax(mBaseInterval, MAX_IDLE_INTERVAL_MS);
+}
+
+int AdaptivePollPolicy::interval() const
+{
+    return mInterval;
+}
+
+int AdaptivePollPolicy::update(int chargeState, double arrayVoltage, double outputPower)
+{
+    bool stateChanged = mHasPrevious && chargeState != mLastState;
+    // PV voltage is relevant below 1 V, power below 10 W is noise.
+    bool fastChange = mHasPrevious &&
+            (changedFast(arrayVoltage, mLastArrayVoltage, 1.0) ||
+             changedFast(outputPower, mLastOutputPower, 10.0));
+    mHasPrevious = true;
+    mLastState = chargeState;
+    mLastArrayVoltage = arrayVoltage;
+    mLastOutputPower = outputPower;
+
+    bool trigger = stateChanged || (fastChange && isIdle(chargeState));
+    mQuietPolls = trigger || fastChange ? 0 : mQuietPolls + 1;
+    // The burst budget is only restored once readings have settled, so a
+    // reading that keeps flapping cannot restart the burst after the cap.
+    if (mQuietPolls >= SETTLE_POLLS) {
+        mBurst = false;
+        mBurstPolls = 0;
+    } else if (mBurstPolls >= MAX_BURST_POLLS) {
+        mBurst = false;
+    } else if (trigger) {
+        mBurst = true;
+    }
+
+    if (mBurst) {
+        mBurstPolls++;
+        mInterval = burstInterval();
+    } else if (isIdle(chargeState) && !fastChange) {
+        mInterval = qMin(qMax(mInterval, mBaseInterval) * 2, maxIdleInterval());
+    } else {
+        mInterval = mBaseInterval;
+    }
+    return mInterval;
+}
+
+bool AdaptivePollPolicy::isIdle(int chargeState)
+{
+    return chargeState == CS_NIGHT || chargeState == CS_DISCONNECT;
+}
+
+bool AdaptivePollPolicy::changedFast(double value, double previous, double floor)
+{
+    return fabs(value - previous) > CHANGE_THRESHOLD * qMax(fabs(previous), floor);
+}
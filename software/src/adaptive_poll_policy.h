@@ -0,0 +1,60 @@
+#ifndef ADAPTIVE_POLL_POLICY_H
+#define ADAPTIVE_POLL_POLICY_H
+
+/*!
+ * \brief Chooses the interval between polls of the live values.
+ * The interval depends on the charge state of the controller and on how fast
+ * the PV readings change:
+ * - While the controller is idle (night or disconnect) and readings are
+ *   stable, the interval doubles after each poll, up to `maxIdleInterval`.
+ * - After a charge state transition, or when the PV voltage or power changes
+ *   quickly during an idle state (sunrise, dusk), the controller is polled at
+ *   the burst interval until readings settle, for at most 30 polls. A new
+ *   burst can only start after the readings have settled.
+ * - Otherwise the configured base interval is used.
+ */
+class AdaptivePollPolicy
+{
+public:
+    AdaptivePollPolicy(int baseIntervalMs);
+
+    void setBaseInterval(int ms);
+    int baseInterval() const;
+
+    /*!
+     * \brief Interval used during a burst: a quarter of the base interval,
+     * but not below 1 s (or the base interval if that is shorter).
+     */
+    int burstInterval() const;
+
+    /*!
+     * \brief Longest interval used while idle: 1 minute, or the base interval
+     * if that is longer.
+     */
+    int maxIdleInterval() const;
+
+    /*!
+     * \brief Feeds the result of a poll of the live values.
+     * \param chargeState The Tristar charge state.
+     * \return The interval until the next poll in ms.
+     */
+    int update(int chargeState, double arrayVoltage, double outputPower);
+
+    int interval() const;
+
+private:
+    static bool isIdle(int chargeState);
+    static bool changedFast(double value, double previous, double floor);
+
+    int mBaseInterval;
+    int mInterval;
+    bool mHasPrevious;
+    int mLastState;
+    double mLastArrayVoltage;
+    double mLastOutputPower;
+    bool mBurst;
+    int mBurstPolls;
+    int mQuietPolls;
+};
+
+#endif // ADAPTIVE_POLL_POLICY_H
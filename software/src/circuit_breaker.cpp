@@ -0,0 +1,35 @@
+#include "circuit_breaker.h"
+
+CircuitBreaker::CircuitBreaker(int initialDelayMs, int maxDelayMs):
+    mState(Closed),
+    mBackoff(initialDelayMs, maxDelayMs)
+{
+}
+
+CircuitBreaker::State CircuitBreaker::state() const
+{
+    return mState;
+}
+
+int CircuitBreaker::trip()
+{
+    mState = Open;
+    return mBackoff.nextDelay();
+}
+
+void CircuitBreaker::probe()
+{
+    if (mState == Open)
+        mState = HalfOpen;
+}
+
+void CircuitBreaker::close()
+{
+    mState = Closed;
+    mBackoff.reset();
+}
+
+int CircuitBreaker::trips() const
+{
+    return mBackoff.attempts();
+}
@@ -0,0 +1,54 @@
+#ifndef CIRCUIT_BREAKER_H
+#define CIRCUIT_BREAKER_H
+
+#include "reconnect_backoff.h"
+
+/*!
+ * \brief Fails fast while a device is known to be down.
+ * While closed, requests are sent as usual and may be retried. A failure
+ * opens the breaker (`trip`): nothing is sent until the delay chosen by
+ * `ReconnectBackoff` has passed. The breaker is then half open (`probe`): a
+ * single request is sent, without retries. If it succeeds the breaker closes,
+ * otherwise it opens again with a longer delay.
+ */
+class CircuitBreaker
+{
+public:
+    enum State {
+        Closed,
+        Open,
+        HalfOpen
+    };
+
+    CircuitBreaker(int initialDelayMs, int maxDelayMs);
+
+    State state() const;
+
+    /*!
+     * \brief Opens the breaker.
+     * \return The time in ms until the next probe.
+     */
+    int trip();
+
+    /*!
+     * \brief Half opens the breaker, call when the delay returned by `trip`
+     * has passed.
+     */
+    void probe();
+
+    /*!
+     * \brief Closes the breaker after a successful request.
+     */
+    void close();
+
+    /*!
+     * \brief Number of times the breaker was opened since it was last closed.
+     */
+    int trips() const;
+
+private:
+    State mState;
+    ReconnectBackoff mBackoff;
+};
+
+#endif // CIRCUIT_BREAKER_H
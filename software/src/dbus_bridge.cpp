@@ -1,19 +1,43 @@
+#include <QDBusMessage>
 #include <QDBusVariant>
 #include <QsLog.h>
 #include <QTimer>
 #include <velib/qt/v_busitem.h>
 #include <velib/qt/v_busitems.h>
+#include "v_bus_libdbus_store.h"
 #include "v_bus_node.h"
+#ifdef VBUS_VIRTUAL_OBJECT_STORE
+#include "v_bus_virtual_object_store.h"
+#endif
 #include "dbus_bridge.h"
 
 Q_DECLARE_METATYPE(QList<int>)
 
+// Max staleness deadlines are rounded down to this tick, so items that go
+// stale around the same time are republished together.
+const int POLICY_TICK_MS = 1000;
+
+static const QString ValueKey("Value");
+static const QString TextKey("Text");
+
+#ifdef VBUS_VIRTUAL_OBJECT_STORE
+DBusBridge::ProducerBackend DBusBridge::mProducerBackend = DBusBridge::ItemStore;
+#else
+DBusBridge::ProducerBackend DBusBridge::mProducerBackend = DBusBridge::ItemObjects;
+#endif
+
 DBusBridge::DBusBridge(QObject *parent) :
     QObject(parent),
     mServiceRegistered(false),
     mUpdateBusy(false),
-    mUpdateTimer(0)
+    mUpdateTimer(0),
+    mUninitializedCount(0),
+    mPolicyTimer(new QTimer(this)),
+    mStore(0)
 {
+    mPolicyTimer->setSingleShot(true);
+    connect(mPolicyTimer, SIGNAL(timeout()), this, SLOT(onPolicyTimer()));
+    mClock.start();
 }
 
 DBusBridge::DBusBridge(const QString &serviceName, QObject *parent):
@@ -21,8 +45,14 @@ DBusBridge::DBusBridge(const QString &serviceName, QObject *parent):
     mServiceName(serviceName),
     mServiceRegistered(false),
     mUpdateBusy(false),
-    mUpdateTimer(0)
+    mUpdateTimer(0),
+    mUninitializedCount(0),
+    mPolicyTimer(new QTimer(this)),
+    mStore(0)
 {
+    mPolicyTimer->setSingleShot(true);
+    connect(mPolicyTimer, SIGNAL(timeout()), this, SLOT(onPolicyTimer()));
+    mClock.start();
 }
 
 DBusBridge::~DBusBridge()
@@ -30,8 +60,14 @@ DBusBridge::~DBusBridge()
     if (!mServiceRegistered)
         return;
     QLOG_INFO() << "Unregistering service" << mServiceName;
-    QDBusConnection connection = VBusItems::getConnection(mServiceName);
-    if (!connection.unregisterService(mServiceName)) {
+    bool released;
+    if (mStore != 0) {
+        released = mStore->unregisterService(mServiceName);
+    } else {
+        QDBusConnection connection = VBusItems::getConnection(mServiceName);
+        released = connection.unregisterService(mServiceName);
+    }
+    if (!released) {
         QLOG_FATAL() << "UnregisterService failed";
     }
 }
@@ -42,6 +78,7 @@ void DBusBridge::setUpdateInterval(int interval)
         if (mUpdateTimer != 0) {
             delete mUpdateTimer;
             mUpdateTimer = 0;
+            onUpdateTimer();
         }
         return;
     }
@@ -57,25 +94,36 @@ void DBusBridge::produce(QObject *src, const char *property,
                          const QString &path, const QString &unit,
                          int precision)
 {
-    VBusItem *vbi = new VBusItem(this);
+    produce(src, property, -1, path, unit, precision);
+}
+
+void DBusBridge::produce(QObject *src, const char *property, int changeBit,
+                         const QString &path, const QString &unit,
+                         int precision)
+{
     QVariant value = src->property(property);
     toDBus(path, value);
     if (!value.isValid())
         value = QVariant::fromValue(QList<int>());
-    connectItem(vbi, src, property, path);
-    QDBusConnection connection = VBusItems::getConnection(mServiceName);
-    vbi->produce(connection, path, "?", value, unit, precision);
-    addVBusNodes(path, vbi);
+    produceItem(src, property, changeBit, path, "?", value, unit, precision);
 }
 
 void DBusBridge::produce(const QString &path, const QVariant &value,
                          const QString &unit, int precision)
 {
-    VBusItem *vbi = new VBusItem(this);
-    connectItem(vbi, 0, 0, path);
-    QDBusConnection connection = VBusItems::getConnection(mServiceName);
-    vbi->produce(connection, path, "", value, unit, precision);
-    addVBusNodes(path, vbi);
+    produceItem(0, 0, -1, path, "", value, unit, precision);
+}
+
+void DBusBridge::updateConstant(const QString &path, const QVariant &value)
+{
+    QHash<QString, int>::const_iterator it = mPathItems.constFind(path);
+    if (it == mPathItems.constEnd() || mBusItems[it.value()].src != 0) {
+        QLOG_ERROR() << "DBusBridge: no constant produced on" << path;
+        return;
+    }
+    mUpdateBusy = true;
+    setItemValue(mBusItems[it.value()], value);
+    mUpdateBusy = false;
 }
 
 void DBusBridge::consume(const QString &service, QObject *src,
@@ -83,7 +131,7 @@ void DBusBridge::consume(const QString &service, QObject *src,
 {
     QDBusConnection &connection = VBusItems::getConnection();
     VBusItem *vbi = new VBusItem(this);
-    connectItem(vbi, src, property, path);
+    connectItem(vbi, src, property, path, false);
     vbi->consume(connection, service, path);
     vbi->getValue(); // force value retrieval
 }
@@ -104,6 +152,30 @@ void DBusBridge::consume(const QString &service, QObject *src,
     consume(service, src, property, path);
 }
 
+void DBusBridge::setProducerBackend(ProducerBackend backend)
+{
+    mProducerBackend = isProducerBackendSupported(backend) ? backend : ItemObjects;
+}
+
+DBusBridge::ProducerBackend DBusBridge::producerBackend()
+{
+    return mProducerBackend;
+}
+
+bool DBusBridge::isProducerBackendSupported(ProducerBackend backend)
+{
+#ifdef VBUS_VIRTUAL_OBJECT_STORE
+    return backend == ItemObjects || backend == ItemStore || backend == LibDBus;
+#else
+    return backend == ItemObjects || backend == LibDBus;
+#endif
+}
+
+int DBusBridge::producedCount() const
+{
+    return mPathItems.size();
+}
+
 QString DBusBridge::serviceName() const
 {
     return mServiceName;
@@ -121,8 +193,14 @@ void DBusBridge::registerService()
         return;
     }
     QLOG_INFO() << "Registering service" << mServiceName;
-    QDBusConnection connection = VBusItems::getConnection(mServiceName);
-    if (connection.registerService(mServiceName))
+    bool registered;
+    if (mStore != 0) {
+        registered = mStore->registerService(mServiceName);
+    } else {
+        QDBusConnection connection = VBusItems::getConnection(mServiceName);
+        registered = connection.registerService(mServiceName);
+    }
+    if (registered)
     {
         mServiceRegistered = true;
         emit serviceRegistered();
@@ -147,6 +225,20 @@ bool DBusBridge::addSetting(const QString &path,
                             const QVariant &defaultValue,
                             const QVariant &minValue,
                             const QVariant &maxValue)
+{
+    QDBusMessage m;
+    if (!createAddSettingCall(path, defaultValue, minValue, maxValue, m))
+        return false;
+    QDBusConnection &connection = VBusItems::getConnection();
+    QDBusMessage reply = connection.call(m);
+    return reply.type() == QDBusMessage::ReplyMessage;
+}
+
+bool DBusBridge::createAddSettingCall(const QString &path,
+                                      const QVariant &defaultValue,
+                                      const QVariant &minValue,
+                                      const QVariant &maxValue,
+                                      QDBusMessage &call)
 {
     if (!path.startsWith("/Settings"))
         return false;
@@ -172,97 +264,133 @@ bool DBusBridge::addSetting(const QString &path,
     }
     QString group = path.mid(groupStart + 1, nameStart - groupStart - 1);
     QString name = path.mid(nameStart + 1);
-    QDBusConnection &connection = VBusItems::getConnection();
-    QDBusMessage m = QDBusMessage::createMethodCall(
-                         "com.victronenergy.settings",
-                         "/Settings",
-                         "com.victronenergy.Settings",
-                         "AddSetting")
-                     << group
-                     << name
-                     << QVariant::fromValue(QDBusVariant(defaultValue))
-                     << QString(type)
-                     << QVariant::fromValue(QDBusVariant(minValue))
-                     << QVariant::fromValue(QDBusVariant(maxValue));
-    QDBusMessage reply = connection.call(m);
-    return reply.type() == QDBusMessage::ReplyMessage;
+    call = QDBusMessage::createMethodCall(
+               "com.victronenergy.settings",
+               "/Settings",
+               "com.victronenergy.Settings",
+               "AddSetting")
+           << group
+           << name
+           << QVariant::fromValue(QDBusVariant(defaultValue))
+           << QString(type)
+           << QVariant::fromValue(QDBusVariant(minValue))
+           << QVariant::fromValue(QDBusVariant(maxValue));
+    return true;
 }
 
 void DBusBridge::onPropertyChanged()
 {
-    QObject *src = sender();
-    int signalIndex = senderSignalIndex();
-    for (QList<BusItemBridge>::iterator it = mBusItems.begin(); it != mBusItems.end(); ++it) {
-        if (it->src == src && it->property.isValid() &&
-                it->property.notifySignalIndex() == signalIndex) {
-            if (mUpdateTimer == 0)
-                publishValue(*it);
-            else
-                it->changed = true;
-            break;
-        }
+    QHash<SignalKey, int>::const_iterator it =
+        mPropertyItems.constFind(SignalKey(sender(), senderSignalIndex()));
+    if (it == mPropertyItems.constEnd())
+        return;
+    markChanged(it.value());
+}
+
+void DBusBridge::onValuesUpdated(quint32 changeSet)
+{
+    QHash<QObject *, QVector<int> >::const_iterator items = mChangeSetItems.constFind(sender());
+    if (items == mChangeSetItems.constEnd())
+        return;
+    const QVector<int> &indexes = items.value();
+    for (int bit = 0; changeSet != 0 && bit < indexes.size(); ++bit, changeSet >>= 1) {
+        if ((changeSet & 1) == 0 || indexes[bit] < 0)
+            continue;
+        markChanged(indexes[bit]);
     }
 }
 
 void DBusBridge::onVBusItemChanged()
 {
+    QHash<QObject *, int>::const_iterator index = mVBusItems.constFind(sender());
+    if (index != mVBusItems.constEnd())
+        itemValueChanged(index.value());
+}
+
+void DBusBridge::onStoreValueChanged(int id)
+{
+    if (id >= 0 && id < mStoreItems.size())
+        itemValueChanged(mStoreItems[id]);
+}
+
+void DBusBridge::itemValueChanged(int index)
+{
+    BusItemBridge &item = mBusItems[index];
+    if (item.produced)
+        queueItemsChanged(index);
     if (mUpdateBusy)
         return;
-    bool checkInit = false;
-    for (QList<BusItemBridge>::iterator it = mBusItems.begin();
-         it != mBusItems.end();
-         ++it) {
-        if (it->item == sender()) {
-            if (it->src == 0) {
-                QLOG_WARN() << "Value changed on D-Bus could not be stored in QT-property";
-            } else if (it->property.isValid()) {
-                QVariant value = it->item->getValue();
-                if (value.canConvert<QList<int> >()) {
-                    QList<int> l = value.value<QList<int> >();
-                    if (l.isEmpty())
-                        value = QVariant();
-                }
-                if (fromDBus(it->path, value))
-                    it->src->setProperty(it->property.name(), value);
-            }
-            if (!it->initialized) {
-                it->initialized = true;
-                checkInit = true;
-            }
-            break;
+    if (item.src == 0) {
+        QLOG_WARN() << "Value changed on D-Bus could not be stored in QT-property";
+    } else if (item.property.isValid()) {
+        QVariant value = itemValue(item);
+        if (value.canConvert<QList<int> >()) {
+            QList<int> l = value.value<QList<int> >();
+            if (l.isEmpty())
+                value = QVariant();
         }
+        if (fromDBus(item.path, value))
+            item.src->setProperty(item.property.name(), value);
     }
-    if (checkInit) {
-        foreach (BusItemBridge bib, mBusItems) {
-            if (!bib.initialized) {
-                checkInit = false;
-                break;
-            }
-        }
-        if (checkInit)
+    if (!item.initialized) {
+        item.initialized = true;
+        if (--mUninitializedCount == 0)
             emit initialized();
     }
 }
 
 void DBusBridge::onUpdateTimer()
 {
-    for (QList<BusItemBridge>::iterator it = mBusItems.begin(); it != mBusItems.end(); ++it) {
-        if (it->changed) {
-            publishValue(*it);
-            it->changed = false;
-        }
+    foreach (int index, mChangedItems) {
+        mBusItems[index].changed = false;
+        publishValue(index);
     }
+    mChangedItems.clear();
+}
+
+void DBusBridge::onFlushItemsChanged()
+{
+    // All changes made while handling one event (typically one poll of the
+    // device) are sent in a single D-Bus message.
+    VBusItemChanges changes;
+    foreach (int index, mItemsChanged) {
+        BusItemBridge &item = mBusItems[index];
+        item.itemsChangedPending = false;
+        QVariant value = itemValue(item);
+        if (!value.isValid())
+            value = QVariant::fromValue(QList<int>());
+        // The map of the item and its keys are reused, so only the values
+        // are replaced. The map of all changes is built for each message.
+        item.properties[ValueKey] = value;
+        item.properties[TextKey] = itemText(item);
+        changes.insert(item.path, item.properties);
+    }
+    mItemsChanged.clear();
+    if (changes.isEmpty())
+        return;
+    if (mStore != 0)
+        mStore->publishItemsChanged(changes);
+    if (!mServiceRoot.isNull())
+        mServiceRoot->publishItemsChanged(changes);
+    emit itemsChangedSent();
 }
 
 void DBusBridge::connectItem(VBusItem *busItem, QObject *src,
-                             const char *property, const QString &path)
+                             const char *property, const QString &path,
+                             bool produced, int changeBit)
 {
     BusItemBridge bib;
     bib.item = busItem;
+    bib.storeId = -1;
     bib.src = src;
     bib.path = path;
+    bib.produced = produced;
     bib.initialized = false;
     bib.changed = false;
+    bib.itemsChangedPending = false;
+    bib.hasPolicy = false;
+    bib.publishPending = false;
+    bib.lastPublishMs = 0;
     if (src == 0) {
         if (property != 0) {
             QLOG_ERROR() << "Property specified (" << property
@@ -282,18 +410,109 @@ void DBusBridge::connectItem(VBusItem *busItem, QObject *src,
                              << "Path was" << path;
             } else {
                 QMetaProperty mp = mo->property(i);
-                if (mp.hasNotifySignal()) {
+                if (changeBit >= 0 && changeBit < 32) {
+                    QVector<int> &indexes = mChangeSetItems[src];
+                    if (indexes.isEmpty()) {
+                        indexes.fill(-1, 32);
+                        connect(src, SIGNAL(valuesUpdated(quint32)),
+                                this, SLOT(onValuesUpdated(quint32)));
+                    }
+                    indexes[changeBit] = mBusItems.size();
+                } else if (mp.hasNotifySignal()) {
                     QMetaMethod signal = mp.notifySignal();
                     int index = metaObject()->indexOfSlot("onPropertyChanged()");
                     QMetaMethod slot = metaObject()->method(index);
                     connect(src, signal, this, slot);
+                    mPropertyItems.insert(SignalKey(src, mp.notifySignalIndex()),
+                                          mBusItems.size());
                 }
                 bib.property = mp;
             }
         }
     }
+    if (produced)
+        mPathItems.insert(path, mBusItems.size());
+    if (busItem != 0) {
+        mVBusItems.insert(busItem, mBusItems.size());
+        connect(busItem, SIGNAL(valueChanged()), this, SLOT(onVBusItemChanged()));
+    }
     mBusItems.push_back(bib);
-    connect(busItem, SIGNAL(valueChanged()), this, SLOT(onVBusItemChanged()));
+    ++mUninitializedCount;
+}
+
+void DBusBridge::markChanged(int index)
+{
+    BusItemBridge &item = mBusItems[index];
+    if (mUpdateTimer == 0) {
+        publishValue(index);
+    } else if (!item.changed) {
+        item.changed = true;
+        mChangedItems.append(index);
+    }
+}
+
+void DBusBridge::produceItem(QObject *src, const char *property, int changeBit,
+                             const QString &path, const QString &description,
+                             const QVariant &value, const QString &unit,
+                             int precision)
+{
+    if (mProducerBackend != ItemObjects) {
+        if (mStore == 0) {
+            mStore = createStore();
+            connect(mStore, SIGNAL(valueChanged(int)), this, SLOT(onStoreValueChanged(int)));
+        }
+        int id = mStore->addItem(path, value, unit, precision);
+        if (id == -1) {
+            QLOG_ERROR() << "DBusBridge: could not produce" << path;
+            return;
+        }
+        int index = mBusItems.size();
+        connectItem(0, src, property, path, true, changeBit);
+        mBusItems[index].storeId = id;
+        mStoreItems.resize(id + 1);
+        mStoreItems[id] = index;
+        return;
+    }
+    VBusItem *vbi = new VBusItem(this);
+    connectItem(vbi, src, property, path, true, changeBit);
+    QDBusConnection connection = VBusItems::getConnection(mServiceName);
+    vbi->produce(connection, path, description, value, unit, precision);
+    addVBusNodes(path, vbi);
+}
+
+VBusItemStore *DBusBridge::createStore()
+{
+#ifdef VBUS_VIRTUAL_OBJECT_STORE
+    if (mProducerBackend == ItemStore)
+        return new VBusVirtualObjectStore(VBusItems::getConnection(mServiceName), this);
+#endif
+    VBusLibDBusStore *store = new VBusLibDBusStore(this);
+    if (!store->isConnected())
+        QLOG_ERROR() << "DBusBridge: no libdbus connection for" << mServiceName;
+    return store;
+}
+
+QVariant DBusBridge::itemValue(const BusItemBridge &item) const
+{
+    if (item.storeId >= 0)
+        return mStore->value(item.storeId);
+    return item.item->getValue();
+}
+
+QString DBusBridge::itemText(const BusItemBridge &item) const
+{
+    if (item.storeId >= 0)
+        return mStore->text(item.storeId);
+    return item.item->getText();
+}
+
+void DBusBridge::setItemValue(BusItemBridge &item, const QVariant &value)
+{
+    if (item.storeId >= 0) {
+        mStore->setValue(item.storeId, value);
+        return;
+    }
+    item.item->setValue(value);
 }
 
 void DBusBridge::addVBusNodes(const QString &path, VBusItem *vbi)
@@ -305,14 +524,105 @@ void DBusBridge::addVBusNodes(const QString &path, VBusItem *vbi)
     mServiceRoot->addChild(path, vbi);
 }
 
-void DBusBridge::publishValue(DBusBridge::BusItemBridge &item)
+void DBusBridge::queueItemsChanged(int index)
+{
+    BusItemBridge &item = mBusItems[index];
+    if (item.itemsChangedPending)
+        return;
+    item.itemsChangedPending = true;
+    mItemsChanged.append(index);
+    if (mItemsChanged.size() == 1)
+        QMetaObject::invokeMethod(this, "onFlushItemsChanged", Qt::QueuedConnection);
+}
+
+void DBusBridge::publishValue(int index, bool force)
 {
+    BusItemBridge &item = mBusItems[index];
     QVariant value = item.src->property(item.property.name());
     if (!toDBus(item.path, value))
         return;
     if (!value.isValid())
         value = QVariant::fromValue(QList<int>());
+    qint64 now = mClock.elapsed();
+    if (item.hasPolicy && !force && value.type() == QVariant::Double) {
+        QVariant published = itemValue(item);
+        if (published.type() == QVariant::Double &&
+                !item.policy.isSignificant(published.toDouble(), value.toDouble()))
+            return; // Catches up after maxStaleness, if set
+        if (now - item.lastPublishMs < item.policy.minInterval()) {
+            item.publishPending = true;
+            schedulePolicyTimer();
+            return;
+        }
+    }
+    item.publishPending = false;
+    item.lastPublishMs = now;
     mUpdateBusy = true;
-    item.item->setValue(value);
+    setItemValue(item, value);
     mUpdateBusy = false;
 }
+
+void DBusBridge::setPublishPolicy(const QString &path, const PublishPolicy &policy)
+{
+    QHash<QString, int>::const_iterator it = mPathItems.constFind(path);
+    if (it == mPathItems.constEnd() || mBusItems[it.value()].src == 0) {
+        QLOG_ERROR() << "DBusBridge: no property produced on" << path;
+        return;
+    }
+    BusItemBridge &item = mBusItems[it.value()];
+    item.policy = policy;
+    if (!item.hasPolicy) {
+        item.hasPolicy = true;
+        mPolicyItems.append(it.value());
+    }
+    schedulePolicyTimer();
+}
+
+qint64 DBusBridge::stalenessDeadline(const BusItemBridge &item)
+{
+    // Never later than maxStaleness, and always after the last publish.
+    qint64 tick = qMin(POLICY_TICK_MS, item.policy.maxStaleness());
+    return (item.lastPublishMs + item.policy.maxStaleness()) / tick * tick;
+}
+
+void DBusBridge::onPolicyTimer()
+{
+    qint64 now = mClock.elapsed();
+    QVector<int> stale;
+    foreach (int index, mPolicyItems) {
+        BusItemBridge &item = mBusItems[index];
+        if (item.publishPending) {
+            if (now - item.lastPublishMs >= item.policy.minInterval())
+                publishValue(index, true);
+        } else if (item.policy.maxStaleness() > 0 && stalenessDeadline(item) <= now) {
+            // Publish the latest value, and announce it even if unchanged.
+            publishValue(index, true);
+            stale.append(index);
+        }
+    }
+    // All items due at this tick go out in a single ItemsChanged message.
+    foreach (int index, stale)
+        queueItemsChanged(index);
+    schedulePolicyTimer();
+}
+
+void DBusBridge::schedulePolicyTimer()
+{
+    qint64 next = -1;
+    foreach (int index, mPolicyItems) {
+        const BusItemBridge &item = mBusItems[index];
+        qint64 deadline = -1;
+        if (item.publishPending)
+            deadline = item.lastPublishMs + item.policy.minInterval();
+        else if (item.policy.maxStaleness() > 0)
+            deadline = stalenessDeadline(item);
+        if (deadline >= 0 && (next < 0 || deadline < next))
+            next = deadline;
+    }
+    if (next < 0) {
+        mPolicyTimer->stop();
+        return;
+    }
+    qint64 wait = next - mClock.elapsed();
+    mPolicyTimer->start(wait > 0 ? (int)wait : 0);
+}
@@ -1,25 +1,35 @@
 #ifndef DBUS_BRIDGE_H
 #define DBUS_BRIDGE_H
 
+#include <QElapsedTimer>
+#include <QHash>
 #include <QList>
 #include <QMetaProperty>
 #include <QObject>
+#include <QPair>
 #include <QPointer>
 #include <QString>
+#include <QVariant>
+#include <QVector>
+#include "publish_policy.h"
 
 class QDBusConnection;
+class QDBusMessage;
 class QDBusVariant;
 class QTimer;
 class VBusItem;
+class VBusItemStore;
 class VBusNode;
 
 /*!
  * \brief Synchronizes QT properties with DBus objects.
  * This class synchronizes properties defined by Q_PROPERTY with objects on the
  * DBus. Whenever the value of a QT property changes, the associated SetItem
- * function will be called on the DBus and the PropertiesChanged (DBus) signal
- * will be fired. DBusBridge will also update the QT property if the DBus object
- * changes.
+ * function will be called on the DBus. The changes of all produced objects are
+ * collected and announced in a single ItemsChanged (DBus) signal on the root
+ * object of the service. The PropertiesChanged signal of each object is only
+ * sent if enabled with `VBusItems::setItemSignalsEnabled`. DBusBridge will also
+ * update the QT property if the DBus object changes.
  * This class assumes that the DBus object has the usual victron layout. So
  * each object should have the methods GetValue, SetValue, and GetText as well
  * as the PropertiesChanged signal.
@@ -28,6 +38,15 @@ class DBusBridge : public QObject
 {
     Q_OBJECT
 public:
+    /*!
+     * \brief How produced items are put on the DBus.
+     */
+    enum ProducerBackend {
+        ItemObjects,    // A VBusItem (and D-Bus object) per path, VBusNodes
+        ItemStore,      // One VBusVirtualObjectStore per service, Qt 5.1 and later
+        LibDBus         // One VBusLibDBusStore (own connection) per service
+    };
+
     explicit DBusBridge(QObject *parent);
 
     DBusBridge(const QString &serviceName, QObject *parent);
@@ -52,6 +71,18 @@ public:
     void produce(QObject *src, const char *property, const QString &path,
                  const QString &unit = QString(), int precision = -1);
 
+    /*!
+     * \brief Connects a QT property to a DBus object through a change set.
+     * Same as the function above, but instead of the notify signal of the
+     * property, the `valuesUpdated(quint32)` signal of `src` is used. The DBus
+     * object is updated when bit `changeBit` is set in the change set passed
+     * to the signal. Use this when `src` changes many properties at once: all
+     * of them are then handled in a single signal dispatch.
+     */
+    void produce(QObject *src, const char *property, int changeBit,
+                 const QString &path, const QString &unit = QString(),
+                 int precision = -1);
+
     /*!
      * \brief Pushes a constant value to the DBus, and registers the object.
      * `value` will be pushed (SetValue) to the DBus object specified by
@@ -67,6 +98,12 @@ public:
     void produce(const QString &path, const QVariant &value,
                  const QString &unit = QString(), int precision = -1);
 
+    /*!
+     * \brief Changes the value of an item produced with the function above.
+     * The change is announced in the ItemsChanged signal like other changes.
+     */
+    void updateConstant(const QString &path, const QVariant &value);
+
     /*!
      * \brief Connects a QT property to an existing DBus item.
      * Connects the QT property specified by `src` and `property` to the
@@ -87,6 +124,26 @@ public:
                  QObject *src, const char *property, double defaultValue,
                  double minValue, double maxValue, const QString &path);
 
+    /*!
+     * \brief Sets the policy deciding when changes of the property produced
+     * on `path` are published. By default every change is published
+     * immediately.
+     */
+    void setPublishPolicy(const QString &path, const PublishPolicy &policy);
+
+    /*!
+     * \brief Selects the backend of all bridges created afterwards. Falls back
+     * to `ItemObjects` if the backend is not supported by this build.
+     */
+    static void setProducerBackend(ProducerBackend backend);
+    static ProducerBackend producerBackend();
+    static bool isProducerBackendSupported(ProducerBackend backend);
+
+    /*!
+     * \brief The number of paths produced by this bridge.
+     */
+    int producedCount() const;
+
     QString serviceName() const;
 
     void setServiceName(const QString &sn);
@@ -96,10 +153,25 @@ public:
     static bool addSetting(const QString &path, const QVariant &defaultValue,
                            const QVariant &minValue, const QVariant &maxValue);
 
+    /*!
+     * \brief Builds the AddSetting call of localsettings used by `addSetting`,
+     * so it can also be sent asynchronously.
+     * \retval false if `path` is not below /Settings/<group>, or the type of
+     * `defaultValue` is not supported.
+     */
+    static bool createAddSettingCall(const QString &path, const QVariant &defaultValue,
+                                     const QVariant &minValue, const QVariant &maxValue,
+                                     QDBusMessage &call);
+
 signals:
     void initialized();
     void serviceRegistered();
 
+    /*!
+     * \brief Emitted after an ItemsChanged signal has been sent.
+     */
+    void itemsChangedSent();
+
 protected:
     /*!
      * \brief Allows conversion of values sent to DBus.
@@ -130,34 +202,90 @@ protected:
 private slots:
     void onPropertyChanged();
 
+    void onValuesUpdated(quint32 changeSet);
+
     void onVBusItemChanged();
 
+    void onStoreValueChanged(int id);
+
     void onUpdateTimer();
 
+    void onFlushItemsChanged();
+
+    void onPolicyTimer();
+
 private:
     void connectItem(VBusItem *item, QObject *src, const char *property,
-                     const QString &path);
+                     const QString &path, bool produced, int changeBit = -1);
 
     void addVBusNodes(const QString &path, VBusItem *vbi);
 
     struct BusItemBridge
     {
-        VBusItem *item;
+        VBusItem *item;         // 0 if the item is in mStore
+        int storeId;            // -1 if the item is a VBusItem
         QObject *src;
         QMetaProperty property;
         QString path;
+        bool produced;
         bool initialized;
         bool changed;
+        bool itemsChangedPending;
+        PublishPolicy policy;
+        bool hasPolicy;
+        bool publishPending;    // Change held back by the minimum interval
+        qint64 lastPublishMs;
+        QVariantMap properties; // Reused for ItemsChanged
     };
 
-    void publishValue(BusItemBridge &item);
+    typedef QPair<QObject *, int> SignalKey; // Sender and signal index
+
+    void produceItem(QObject *src, const char *property, int changeBit,
+                     const QString &path, const QString &description,
+                     const QVariant &value, const QString &unit, int precision);
+
+    void itemValueChanged(int index);
 
+    VBusItemStore *createStore();
+
+    QVariant itemValue(const BusItemBridge &item) const;
+
+    QString itemText(const BusItemBridge &item) const;
+
+    void setItemValue(BusItemBridge &item, const QVariant &value);
+
+    void publishValue(int index, bool force = false);
+
+    void queueItemsChanged(int index);
+
+    void schedulePolicyTimer();
+
+    static qint64 stalenessDeadline(const BusItemBridge &item);
+
+    void markChanged(int index);
+
+    // Items are never removed, so indexes in mBusItems remain valid.
     QList<BusItemBridge> mBusItems;
+    QHash<SignalKey, int> mPropertyItems;
+    QHash<QObject *, int> mVBusItems;
+    QVector<int> mChangedItems;
+    QVector<int> mItemsChanged; // Items to include in the next ItemsChanged
+    QHash<QString, int> mPathItems; // Produced items by path
+    QVector<int> mPolicyItems;
+    // Index in mBusItems for each change set bit, per source
+    QHash<QObject *, QVector<int> > mChangeSetItems;
     QPointer<VBusNode> mServiceRoot;
     QString mServiceName;
     bool mServiceRegistered;
     bool mUpdateBusy;
     QTimer *mUpdateTimer;
+    int mUninitializedCount;
+    QTimer *mPolicyTimer;
+    QElapsedTimer mClock;
+    VBusItemStore *mStore;
+    QVector<int> mStoreItems; // Index in mBusItems by store ID
+
+    static ProducerBackend mProducerBackend;
 };
 
 #endif // DBUS_BRIDGE_H
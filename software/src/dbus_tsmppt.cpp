@@ -1,25 +1,55 @@
 #include <QsLog.h>
+#include <QTimer>
 #include <velib/qt/v_busitem.h>
 #include "dbus_tsmppt.h"
 #include "tsmppt.h"
 #include "dbus_tsmppt_bridge.h"
+#include "process_stats.h"
 
-static const QString PortNumberPath = "/Settings/TristarMPPT/PortNumber";
-static const QString IpAddressPath = "/Settings/TristarMPPT/IPAddress";
-static const QString IntervalPath = "/Settings/TristarMPPT/Interval";
+static const QString SettingsRoot = "/Settings/TristarMPPT";
+static const QString ServiceBase = "com.victronenergy.solarcharger.tsmppt";
+// Settings changed within this time are applied at once
+static const int SETTINGS_DEBOUNCE_MS = 500;
 
-DBusTsmppt::DBusTsmppt(QObject *parent): 
-QObject(parent), mTsmpptBridge(0), mIpAddress(new VBusItem(this)), mPortNumber(new VBusItem(this)), mInterval(new VBusItem(this))
+DBusTsmppt::DBusTsmppt(int index, QObject *parent):
+QObject(parent), mIndex(index), mTsmpptBridge(0), mTsmppt(0), mApplyTimer(new QTimer(this)), mIpAddress(new VBusItem(this)), mPortNumber(new VBusItem(this)),
+mInterval(new VBusItem(this)), mTimeout(new VBusItem(this)), mUnitId(new VBusItem(this)), mDeviceInstance(new VBusItem(this))
 {
+    mApplyTimer->setSingleShot(true);
+    mApplyTimer->setInterval(SETTINGS_DEBOUNCE_MS);
+    connect(mApplyTimer, SIGNAL(timeout()), this, SLOT(applySettings()));
+    connect(mDeviceInstance, SIGNAL(valueChanged()), this, SLOT(onDeviceInstanceChanged()));
+    mDeviceInstance->consume("com.victronenergy.settings", settingsPath(mIndex, "DeviceInstance"));
+    mDeviceInstance->getValue();
     connect(mPortNumber, SIGNAL(valueChanged()), this, SLOT(onPortNumberChanged()));
-    mPortNumber->consume("com.victronenergy.settings", PortNumberPath);
+    mPortNumber->consume("com.victronenergy.settings", settingsPath(mIndex, "PortNumber"));
     mPortNumber->getValue();
     connect(mIpAddress, SIGNAL(valueChanged()), this, SLOT(onIpAddressChanged()));
-    mIpAddress->consume("com.victronenergy.settings", IpAddressPath);
+    mIpAddress->consume("com.victronenergy.settings", settingsPath(mIndex, "IPAddress"));
     mIpAddress->getValue();
     connect(mInterval, SIGNAL(valueChanged()), this, SLOT(onIntervalChanged()));
-    mInterval->consume("com.victronenergy.settings", IntervalPath);
+    mInterval->consume("com.victronenergy.settings", settingsPath(mIndex, "Interval"));
     mInterval->getValue();
+    connect(mTimeout, SIGNAL(valueChanged()), this, SLOT(onTimeoutChanged()));
+    mTimeout->consume("com.victronenergy.settings", settingsPath(mIndex, "Timeout"));
+    mTimeout->getValue();
+    connect(mUnitId, SIGNAL(valueChanged()), this, SLOT(onUnitIdChanged()));
+    mUnitId->consume("com.victronenergy.settings", settingsPath(mIndex, "UnitId"));
+    mUnitId->getValue();
+}
+
+QString DBusTsmppt::settingsPath(int index, const QString &name)
+{
+    if (index == 0)
+        return SettingsRoot + "/" + name;
+    return SettingsRoot + "/" + QString::number(index) + "/" + name;
+}
+
+QString DBusTsmppt::serviceName(int index)
+{
+    if (index == 0)
+        return ServiceBase;
+    return ServiceBase + "_" + QString::number(index);
 }
 
 void DBusTsmppt::CreateTsmppt()
@@ -30,36 +60,127 @@ void DBusTsmppt::CreateTsmppt()
        return;
     if (mInterval->getValue().toInt() == 0)
        return;
-    Tsmppt *mTsmppt = new Tsmppt(mIpAddress->getValue().toString(), mPortNumber->getValue().toInt(), mInterval->getValue().toInt());
+    long rssBefore = residentMemoryKb();
+    mTsmppt = new Tsmppt(mIpAddress->getValue().toString(), mPortNumber->getValue().toInt(), mInterval->getValue().toInt(),
+                         unitId());
+    mTsmppt->setTimeout(mTimeout->getValue().toInt());
     connect(mTsmppt, SIGNAL(connectionLost()), this, SLOT(onConnectionLost()));
-    mTsmpptBridge = new DBusTsmpptBridge(mTsmppt, this);
+    mTsmpptBridge = new DBusTsmpptBridge(mTsmppt, serviceName(mIndex), deviceInstance(), this);
+    // After the bridge, so the bridge has queued the ItemsChanged signal of
+    // the values when the slot runs
+    connect(mTsmppt, SIGNAL(valuesUpdated(quint32)), this, SLOT(onValuesUpdated()));
+    long rssAfter = residentMemoryKb();
+    int paths = mTsmpptBridge->producedCount();
+    QLOG_INFO() << "Controller" << mIndex << "(" << serviceName(mIndex) << ") created, resident memory"
+                << rssAfter << "kB (+" << rssAfter - rssBefore << "kB," << paths << "paths,"
+                << (paths > 0 ? (rssAfter - rssBefore) * 1024 / paths : 0) << "bytes per path, producer"
+                << (DBusBridge::producerBackend() == DBusBridge::ItemStore ? "store)" :
+                    DBusBridge::producerBackend() == DBusBridge::LibDBus ? "libdbus)" : "objects)");
 }
 
 void DBusTsmppt::onIpAddressChanged()
 {
-    QLOG_INFO() << "IP Address changed";
-    delete mTsmpptBridge;
-    CreateTsmppt();
+    QLOG_INFO() << "IP Address changed, controller" << mIndex;
+    scheduleApply();
 }
 
 void DBusTsmppt::onIntervalChanged()
 {
-    QLOG_INFO() << "Logging interval changed";
-    delete mTsmpptBridge;
-    CreateTsmppt();
+    QLOG_INFO() << "Logging interval changed, controller" << mIndex;
+    scheduleApply();
+}
+
+void DBusTsmppt::onTimeoutChanged()
+{
+    QLOG_INFO() << "Modbus timeout changed, controller" << mIndex;
+    scheduleApply();
+}
+
+void DBusTsmppt::onUnitIdChanged()
+{
+    QLOG_INFO() << "Unit ID changed, controller" << mIndex;
+    scheduleApply();
+}
+
+void DBusTsmppt::onDeviceInstanceChanged()
+{
+    QLOG_INFO() << "Device instance changed, controller" << mIndex;
+    scheduleApply();
 }
 
 void DBusTsmppt::onPortNumberChanged()
 {
-    QLOG_INFO() << "Port number changed";
-    delete mTsmpptBridge;
-    CreateTsmppt();
+    QLOG_INFO() << "Port number changed, controller" << mIndex;
+    scheduleApply();
+}
+
+int DBusTsmppt::unitId() const
+{
+    // Invalid until localsettings has answered
+    QVariant v = mUnitId->getValue();
+    return v.isValid() ? v.toInt() : 1;
+}
+
+int DBusTsmppt::deviceInstance() const
+{
+    // The index of the controller until localsettings has answered
+    QVariant v = mDeviceInstance->getValue();
+    return v.isValid() ? v.toInt() : mIndex;
+}
+
+void DBusTsmppt::scheduleApply()
+{
+    // At startup all settings arrive one after another, the service is
+    // created once when the last one is in.
+    mApplyTimer->start();
+}
+
+void DBusTsmppt::onValuesUpdated()
+{
+    if (!mTsmppt->connected())
+        return;
+    // Only the first values after startup are of interest. They are
+    // published when the bridge sends its queued ItemsChanged signal.
+    disconnect(mTsmppt, SIGNAL(valuesUpdated(quint32)), this, SLOT(onValuesUpdated()));
+    connect(mTsmpptBridge, SIGNAL(itemsChangedSent()), this, SLOT(onItemsChangedSent()));
+}
+
+void DBusTsmppt::onItemsChangedSent()
+{
+    disconnect(mTsmpptBridge, SIGNAL(itemsChangedSent()), this, SLOT(onItemsChangedSent()));
+    QLOG_INFO() << "Controller" << mIndex << "first values published"
+                << processAgeMs() << "ms after start";
+}
+
+void DBusTsmppt::applySettings()
+{
+    QString ipAddress = mIpAddress->getValue().toString();
+    int port = mPortNumber->getValue().toInt();
+    int interval = mInterval->getValue().toInt();
+    if (ipAddress.isEmpty() || port == 0 || interval == 0) {
+        if (mTsmpptBridge != 0) {
+            QLOG_INFO() << "Controller" << mIndex << "not configured, removing service";
+            delete mTsmpptBridge;
+            mTsmpptBridge = 0;
+            mTsmppt = 0;
+        }
+        return;
+    }
+    if (mTsmpptBridge == 0) {
+        CreateTsmppt();
+        return;
+    }
+    mTsmppt->setTarget(ipAddress, port, unitId());
+    mTsmppt->setInterval(interval);
+    mTsmppt->setTimeout(mTimeout->getValue().toInt());
+    mTsmpptBridge->setDeviceInstance(deviceInstance());
 }
 
 void DBusTsmppt::onConnectionLost()
 {
-    delete mTsmpptBridge;
-    CreateTsmppt();
+    // The service is kept, the acquisition reconnects with a backoff.
+    QLOG_WARN() << "Controller" << mIndex << "(" << serviceName(mIndex)
+                << ") connection lost, values invalidated";
 }
 
 
@@ -2,15 +2,31 @@
 #define DBUS_TSMPPT_H
 
 #include <QObject>
+#include <QString>
 
 class DBusTsmpptBridge;
+class QTimer;
+class Tsmppt;
 class VBusItem;
 
+/*!
+ * \brief Manages one charge controller.
+ * Reads the settings of controller `index` from localsettings and creates
+ * the D-Bus service of the controller once they are complete. Changes of the
+ * settings are collected for a short time and then applied to the existing
+ * service, without registering it again.
+ * Controller 0 uses the settings in /Settings/TristarMPPT and the service
+ * com.victronenergy.solarcharger.tsmppt, controller n > 0 uses
+ * /Settings/TristarMPPT/n and com.victronenergy.solarcharger.tsmppt_n.
+ */
 class DBusTsmppt : public QObject
 {
     Q_OBJECT
 public:
-    DBusTsmppt(QObject *parent = 0);
+    DBusTsmppt(int index, QObject *parent = 0);
+
+    static QString settingsPath(int index, const QString &name);
+    static QString serviceName(int index);
 
 signals:
     void terminateApp();
@@ -19,14 +35,29 @@ private slots:
     void onIpAddressChanged();
     void onPortNumberChanged();
     void onIntervalChanged();
+    void onTimeoutChanged();
+    void onUnitIdChanged();
+    void onDeviceInstanceChanged();
     void onConnectionLost();
+    void onValuesUpdated();
+    void onItemsChangedSent();
+    void applySettings();
 
 private:
+    int mIndex;
     DBusTsmpptBridge *mTsmpptBridge;
+    Tsmppt *mTsmppt;            // Owned by mTsmpptBridge
+    QTimer *mApplyTimer;
     VBusItem *mIpAddress;
     VBusItem *mPortNumber;
     VBusItem *mInterval;
+    VBusItem *mTimeout;
+    VBusItem *mUnitId;
+    VBusItem *mDeviceInstance;
     void CreateTsmppt();
+    int unitId() const;
+    int deviceInstance() const;
+    void scheduleApply();
 };
 
 #endif // DBUS_TSMPPT_H
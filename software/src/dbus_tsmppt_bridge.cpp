@@ -6,15 +6,16 @@
 
 #define VE_PROD_ID_TRISTAR_MPPT_60A 0xABCD
 
+// Values held back by their publish policy are republished after this time
+const int MAX_STALENESS_MS = 60000;
 
-static const QString service = "com.victronenergy.solarcharger.tsmppt";
 
-DBusTsmpptBridge::DBusTsmpptBridge(Tsmppt *tsmppt, QObject *parent):
-    DBusBridge(service, parent),
+DBusTsmpptBridge::DBusTsmpptBridge(Tsmppt *tsmppt, const QString &serviceName, int deviceInstance,
+                                   QObject *parent):
+    DBusBridge(serviceName, parent),
     mTsmppt(tsmppt) 
 {
     Q_ASSERT(tsmppt != 0);
-    connect(tsmppt, SIGNAL(tsmpptConnected()), this, SLOT(onTsmpptConnected()));
     connect(this, SIGNAL(serviceRegistered()), tsmppt, SLOT(startLogging()));
 
     QString processName = QCoreApplication::arguments()[0];
@@ -22,32 +23,31 @@ DBusTsmpptBridge::DBusTsmpptBridge(Tsmppt *tsmppt, QObject *parent):
     produce("/Mgmt/ProcessVersion", QCoreApplication::applicationVersion());
     produce("/Mgmt/Connection", "Modbus-TCP");
     produce("/ProductId", VE_PROD_ID_TRISTAR_MPPT_60A);
-    produce("/DeviceInstance", 0);
+    produce("/DeviceInstance", deviceInstance);
     produce("/ErrorCode", 0);
+    // The service stays registered while the Modbus connection is restored.
+    produce(mTsmppt, "connected", "/Connected");
+    produce("/Mode", 1);
 
-    produce(mTsmppt, "arrayCurrent", "/Pv/I", "A", 2);
-    produce(mTsmppt, "arrayVoltage", "/Pv/V", "V", 2);
-    produce(mTsmppt, "outputPower", "/Yield/Power", "W", 0);
-    produce(mTsmppt, "chargingCurrent", "/Dc/0/Current", "A", 2);
-    produce(mTsmppt, "batteryVoltage", "/Dc/0/Voltage", "V", 2); 
-    produce(mTsmppt, "batteryTemperature", "/Dc/0/Temperature");
-    produce(mTsmppt, "chargeState", "/State");
+    for (int i = 0; i < RegisterCount; ++i) {
+        const RegisterDef &r = RegisterMap[i];
+        if (r.path == 0)
+            continue;
+        produceMeasured(r.property, i, r.path, r.unit, r.precision);
+        // Only publish changes visible at the displayed precision
+        if (r.precision >= 0)
+            setPublishPolicy(r.path, PublishPolicy::forPrecision(r.precision)
+                                     .setMaxStaleness(MAX_STALENESS_MS));
+    }
+    produceMeasured("yieldUser", Tsmppt::YieldUserValue, "/Yield/User", "kWh", 0);
+    produceMeasured("yieldSystem", Tsmppt::YieldSystemValue, "/Yield/System", "kWh", 0);
+    produceMeasured("timeInBulk", Tsmppt::TimeInBulkValue, "/History/Daily/0/TimeInBulk");
 
     produce("/History/Overall/DaysAvailable", 1);
-    produce(mTsmppt, "batteryVoltageMaxDaily", "/History/Daily/0/MaxBatteryVoltage", "V", 2);
-    produce(mTsmppt, "batteryVoltageMinDaily", "/History/Daily/0/MinBatteryVoltage", "V", 2);
-    produce(mTsmppt, "powerMaxDaily", "/History/Daily/0/MaxPower", "W", 0);
-    produce(mTsmppt, "arrayVoltageMaxDaily", "/History/Daily/0/MaxPvVoltage", "V", 2);
-    produce(mTsmppt, "wattHoursDaily", "/History/Daily/0/Yield", "kWh", 2);
-    produce(mTsmppt, "yieldUser", "/Yield/User", "kWh", 0);
-    produce(mTsmppt, "yieldSystem", "/Yield/System", "kWh", 0);
-    produce(mTsmppt, "timeInAbsorption", "/History/Daily/0/TimeInAbsorption");
-    produce(mTsmppt, "timeInBulk", "/History/Daily/0/TimeInBulk");
-    produce(mTsmppt, "timeInFloat", "/History/Daily/0/TimeInFloat");
-    produce(mTsmppt, "firmwareVersion", "/FirmwareVersion");
-    produce(mTsmppt, "hardwareVersion", "/HardwareVersion");
-    produce(mTsmppt, "productName", "/ProductName");
-    produce(mTsmppt, "serialNumber", "/Serial");
+    produce(mTsmppt, "firmwareVersion", Tsmppt::FirmwareVersionValue, "/FirmwareVersion");
+    produce(mTsmppt, "hardwareVersion", Tsmppt::HardwareVersionValue, "/HardwareVersion");
+    produce(mTsmppt, "productName", Tsmppt::ProductNameValue, "/ProductName");
+    produce(mTsmppt, "serialNumber", Tsmppt::SerialNumberValue, "/Serial");
 
     registerService();
 }
@@ -58,9 +58,23 @@ DBusTsmpptBridge::~DBusTsmpptBridge()
    delete mTsmppt;
 }
 
+void DBusTsmpptBridge::setDeviceInstance(int deviceInstance)
+{
+    updateConstant("/DeviceInstance", deviceInstance);
+}
 
-void DBusTsmpptBridge::onTsmpptConnected()
+bool DBusTsmpptBridge::toDBus(const QString &path, QVariant &v)
 {
-    produce("/Connected", 1);
-    produce("/Mode", 1);
+    if (!mTsmppt->connected() && mMeasuredPaths.contains(path))
+        v = QVariant();
+    return true;
+}
+
+void DBusTsmpptBridge::produceMeasured(const char *property, int changeBit,
+                                       const QString &path, const QString &unit,
+                                       int precision)
+{
+    // Before produce, which passes the initial value through toDBus
+    mMeasuredPaths.insert(path);
+    produce(mTsmppt, property, changeBit, path, unit, precision);
 }
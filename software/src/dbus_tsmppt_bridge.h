@@ -2,6 +2,7 @@
 #define DBUS_TSMPPT_BRIDGE_H
 
 #include <QObject>
+#include <QSet>
 #include "dbus_bridge.h"
 
 class Tsmppt;
@@ -10,14 +11,25 @@ class DBusTsmpptBridge : public DBusBridge
 {
     Q_OBJECT
 public:
-    DBusTsmpptBridge(Tsmppt *tsmppt, QObject *parent = 0);
+    DBusTsmpptBridge(Tsmppt *tsmppt, const QString &serviceName, int deviceInstance,
+                     QObject *parent = 0);
     ~DBusTsmpptBridge();
 
-private slots:
-    void onTsmpptConnected();
+    void setDeviceInstance(int deviceInstance);
+
+protected:
+    /*!
+     * \brief Publishes the measured values as invalid while the controller is
+     * not connected.
+     */
+    virtual bool toDBus(const QString &path, QVariant &v);
 
 private:
+    void produceMeasured(const char *property, int changeBit, const QString &path,
+                         const QString &unit = QString(), int precision = -1);
+
     Tsmppt *mTsmppt;
+    QSet<QString> mMeasuredPaths;
 };
 
 #endif // DBUS_TSMPPT_BRIDGE_H
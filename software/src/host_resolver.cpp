@@ -0,0 +1,87 @@
+#include <QHostInfo>
+#include <QsLog.h>
+#include "host_resolver.h"
+
+QHash<QString, HostResolver::Entry> HostResolver::mCache;
+
+HostResolver::HostResolver(QObject *parent):
+    QObject(parent),
+    mLookupId(-1),
+    mLastLookupMs(0)
+{
+}
+
+HostResolver::Result HostResolver::resolve(const QString &host, QHostAddress &address)
+{
+    if (address.setAddress(host))
+        return Resolved;
+    QHash<QString, Entry>::const_iterator it = mCache.constFind(host);
+    if (it != mCache.constEnd() && it->expiresMs > now()) {
+        if (it->address.isNull()) {
+            mErrorString = it->error;
+            return Failed;
+        }
+        address = it->address;
+        return Resolved;
+    }
+    if (mLookupId != -1 && host == mHost)
+        return Pending;
+    abort();
+    mHost = host;
+    mLookupTimer.start();
+    mLookupId = QHostInfo::lookupHost(host, this, SLOT(onLookedUp(QHostInfo)));
+    return Pending;
+}
+
+void HostResolver::forget(const QString &host)
+{
+    mCache.remove(host);
+}
+
+void HostResolver::abort()
+{
+    if (mLookupId == -1)
+        return;
+    QHostInfo::abortHostLookup(mLookupId);
+    mLookupId = -1;
+}
+
+QString HostResolver::errorString() const
+{
+    return mErrorString;
+}
+
+int HostResolver::lastLookupMs() const
+{
+    return mLastLookupMs;
+}
+
+void HostResolver::onLookedUp(const QHostInfo &info)
+{
+    if (info.lookupId() != mLookupId)
+        return;
+    mLookupId = -1;
+    mLastLookupMs = mLookupTimer.elapsed();
+    Entry entry;
+    if (info.error() == QHostInfo::NoError && !info.addresses().isEmpty()) {
+        entry.address = info.addresses().first();
+        entry.expiresMs = now() + PositiveTtlMs;
+        QLOG_DEBUG() << "HostResolver:" << mHost << "is" << entry.address.toString()
+                     << "(" << mLastLookupMs << "ms)";
+    } else {
+        entry.error = info.error() == QHostInfo::NoError ?
+                    QString("No address for %1").arg(mHost) : info.errorString();
+        entry.expiresMs = now() + NegativeTtlMs;
+        QLOG_WARN() << "HostResolver:" << entry.error << "(" << mLastLookupMs << "ms)";
+    }
+    mCache.insert(mHost, entry);
+    emit finished();
+}
+
+qint64 HostResolver::now()
+{
+    static QElapsedTimer clock;
+    if (!clock.isValid())
+        clock.start();
+    return clock.elapsed();
+}
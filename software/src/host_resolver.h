@@ -0,0 +1,88 @@
+#ifndef HOST_RESOLVER_H
+#define HOST_RESOLVER_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QHostAddress>
+#include <QObject>
+#include <QString>
+
+class QHostInfo;
+
+/*!
+ * \brief Resolves the host name of a device without blocking, with a cache.
+ * Lookups are done by QHostInfo in the background. Their results are kept in
+ * a cache shared by all resolvers for `PositiveTtlMs`; a failed lookup is kept
+ * for `NegativeTtlMs`, so a missing DNS server is not asked again on every
+ * reconnect. IP address literals are never looked up.
+ * The cache is not locked: all resolvers must live in the same thread (the
+ * acquisition thread).
+ */
+class HostResolver : public QObject
+{
+    Q_OBJECT
+public:
+    enum Result {
+        Resolved,
+        Failed,
+        Pending         // `finished` is emitted when the lookup completes
+    };
+
+    static const int PositiveTtlMs = 5 * 60000;
+    static const int NegativeTtlMs = 10000;
+
+    explicit HostResolver(QObject *parent = 0);
+
+    /*!
+     * \brief Returns the address of `host` from the cache if possible,
+     * otherwise starts a lookup. Call again after `finished` to get its result.
+     */
+    Result resolve(const QString &host, QHostAddress &address);
+
+    /*!
+     * \brief Removes `host` from the cache, for example when its cached
+     * address could not be connected to.
+     */
+    static void forget(const QString &host);
+
+    /*!
+     * \brief Cancels the lookup in progress, `finished` will not be emitted.
+     */
+    void abort();
+
+    /*!
+     * \brief Description of the last failed lookup.
+     */
+    QString errorString() const;
+
+    /*!
+     * \brief Duration of the last completed lookup, in ms.
+     */
+    int lastLookupMs() const;
+
+signals:
+    void finished();
+
+private slots:
+    void onLookedUp(const QHostInfo &info);
+
+private:
+    struct Entry
+    {
+        QHostAddress address;   // Null for a failed lookup
+        QString error;
+        qint64 expiresMs;
+    };
+
+    static qint64 now();
+
+    int mLookupId;
+    QString mHost;
+    QString mErrorString;
+    QElapsedTimer mLookupTimer;
+    int mLastLookupMs;
+
+    static QHash<QString, Entry> mCache;
+};
+
+#endif // HOST_RESOLVER_H
@@ -1,11 +1,14 @@
 #include <unistd.h>
 #include <QCoreApplication>
+#include <QEventLoop>
 #include <QsLog.h>
 #include <QStringList>
-#include <velib/qt/v_busitem.h>
 #include <velib/qt/v_busitems.h>
-#include <modbus-version.h>
+#include "dbus_bridge.h"
 #include "dbus_tsmppt.h"
+#include "modbus_tcp_client.h"
+#include "settings_startup.h"
+#include "tsmppt_cache.h"
 
 void initLogger(QsLogging::Level logLevel)
 {
@@ -17,80 +20,13 @@ void initLogger(QsLogging::Level logLevel)
 
     QLOG_INFO() << "dbus-tsmppt" << "v" VERSION << "started";
     QLOG_INFO() << "Built with Qt" << QT_VERSION_STR << "running on" << qVersion();
-    QLOG_INFO() << "Built with libmodbus" << LIBMODBUS_VERSION_STRING;
     QLOG_INFO() << "Built on" << __DATE__ << "at" << __TIME__;
     logger.setLoggingLevel(logLevel);
 }
 
 
-bool initDBus(const QString &dbusAddress)
-{
-    VBusItems::setDBusAddress(dbusAddress);
-
-    QLOG_INFO() << "Wait for local settings on DBus(" << dbusAddress << ")...";
-    VBusItem settings;
-    settings.consume("com.victronenergy.settings", "/Settings");
-    for (int i=0; i<15; i++) {
-        QVariant reply = settings.getValue();
-        QCoreApplication::processEvents(QEventLoop::AllEvents, 100);
-        if (reply.isValid())
-        {
-            QLOG_INFO() << "Local settings found";
-            return true;
-        }
-        QEventLoop l;
-        QTimer::singleShot(2000, &l, SLOT(quit()));
-        l.exec();
-        QLOG_INFO() << "Waiting...";
-    }
-    return false;
-}
-
-
-bool addSetting(const QString &path,
-                const QVariant &defaultValue,
-                const QVariant &minValue,
-                const QVariant &maxValue)
-{
-    if (!path.startsWith("/Settings"))
-        return false;
-    int groupStart = path.indexOf('/', 1);
-    if (groupStart == -1)
-        return false;
-    int nameStart = path.lastIndexOf('/');
-    if (nameStart <= groupStart)
-        return false;
-    QChar type;
-    switch (defaultValue.type()) {
-    case QVariant::Int:
-        type = 'i';
-        break;
-    case QVariant::Double:
-        type = 'f';
-        break;
-    case QVariant::String:
-        type = 's';
-        break;
-    default:
-        return false;
-    }
-    QString group = path.mid(groupStart + 1, nameStart - groupStart - 1);
-    QString name = path.mid(nameStart + 1);
-    QDBusConnection &connection = VBusItems::getConnection();
-    QDBusMessage m = QDBusMessage::createMethodCall(
-                         "com.victronenergy.settings",
-                         "/Settings",
-                         "com.victronenergy.Settings",
-                         "AddSetting")
-                     << group
-                     << name
-                     << QVariant::fromValue(QDBusVariant(defaultValue))
-                     << QString(type)
-                     << QVariant::fromValue(QDBusVariant(minValue))
-                     << QVariant::fromValue(QDBusVariant(maxValue));
-    QDBusMessage reply = connection.call(m);
-    return reply.type() == QDBusMessage::ReplyMessage;
-}
+// Time to wait for localsettings before giving up
+static const int SETTINGS_TIMEOUT_MS = 30000;
 
 extern "C"
 {
@@ -104,7 +40,13 @@ int main(int argc, char *argv[])
 
     bool expectVerbosity = false;
     bool expectDBusAddress = false;
+    bool expectControllers = false;
     QString dbusAddress = "system";
+    int controllers = 1;
+    bool itemSignals = false;
+    bool expectProducer = false;
+    bool expectCacheFile = false;
+    bool expectWindow = false;
     QStringList args = app.arguments();
     args.pop_front();
     foreach (QString arg, args) {
@@ -119,6 +61,28 @@ int main(int argc, char *argv[])
         } else if (expectDBusAddress) {
             dbusAddress = arg;
             expectDBusAddress = false;
+        } else if (expectControllers) {
+            controllers = qMax(1, arg.toInt());
+            expectControllers = false;
+        } else if (expectProducer) {
+            if (arg == "objects") {
+                DBusBridge::setProducerBackend(DBusBridge::ItemObjects);
+            } else if (arg == "store") {
+                if (!DBusBridge::isProducerBackendSupported(DBusBridge::ItemStore))
+                    QLOG_WARN() << "Item store requires Qt 5.1 or later, using objects";
+                DBusBridge::setProducerBackend(DBusBridge::ItemStore);
+            } else if (arg == "libdbus") {
+                DBusBridge::setProducerBackend(DBusBridge::LibDBus);
+            } else {
+                QLOG_WARN() << "Unknown producer" << arg;
+            }
+            expectProducer = false;
+        } else if (expectCacheFile) {
+            TsmpptCache::setFileName(arg);
+            expectCacheFile = false;
+        } else if (expectWindow) {
+            ModbusTcpClient::setDefaultWindow(arg.toInt());
+            expectWindow = false;
         } else if (arg == "-h" || arg == "--help") {
             QLOG_INFO() << app.arguments().first();
             QLOG_INFO() << "\t-h, --help";
@@ -129,6 +93,17 @@ int main(int argc, char *argv[])
             QLOG_INFO() << "\t Set log level";
             QLOG_INFO() << "\t-b, --dbus";
             QLOG_INFO() << "\t dbus address or 'session' or 'system'";
+            QLOG_INFO() << "\t-n count, --controllers count";
+            QLOG_INFO() << "\t Number of charge controllers (default 1)";
+            QLOG_INFO() << "\t-p objects|store|libdbus, --producer objects|store|libdbus";
+            QLOG_INFO() << "\t D-Bus object per path, one store per service (default if supported),";
+            QLOG_INFO() << "\t or one store per service on its own libdbus connection";
+            QLOG_INFO() << "\t-c file, --cache file";
+            QLOG_INFO() << "\t File to cache the identity of the controllers in";
+            QLOG_INFO() << "\t-w count, --window count";
+            QLOG_INFO() << "\t Modbus requests sent without waiting for a reply (default 4)";
+            QLOG_INFO() << "\t--item-signals";
+            QLOG_INFO() << "\t Also send PropertiesChanged for each changed path";
             exit(1);
         } else if (arg == "-V" || arg == "--version") {
             QLOG_INFO() << VERSION;
@@ -140,21 +115,50 @@ int main(int argc, char *argv[])
             logger.setIncludeTimestamp(true);
         } else if (arg == "-b" || arg == "--dbus") {
             expectDBusAddress = true;
+        } else if (arg == "-n" || arg == "--controllers") {
+            expectControllers = true;
+        } else if (arg == "-p" || arg == "--producer") {
+            expectProducer = true;
+        } else if (arg == "-c" || arg == "--cache") {
+            expectCacheFile = true;
+        } else if (arg == "-w" || arg == "--window") {
+            expectWindow = true;
+        } else if (arg == "--item-signals") {
+            itemSignals = true;
         }
     }
 
-    if (!initDBus(dbusAddress)) {
+    VBusItems::setItemSignalsEnabled(itemSignals);
+
+    VBusItems::setDBusAddress(dbusAddress);
+    SettingsStartup startup;
+    for (int i = 0; i < controllers; i++) {
+        startup.addSetting(DBusTsmppt::settingsPath(i, "IPAddress"), "", "", "");
+        startup.addSetting(DBusTsmppt::settingsPath(i, "PortNumber"), 502, 0, 0);
+        startup.addSetting(DBusTsmppt::settingsPath(i, "Interval"), 5000, 0, 0);
+        startup.addSetting(DBusTsmppt::settingsPath(i, "Timeout"), 5000, 0, 0);
+        startup.addSetting(DBusTsmppt::settingsPath(i, "UnitId"), 1, 0, 0);
+        startup.addSetting(DBusTsmppt::settingsPath(i, "DeviceInstance"), i, 0, 0);
+    }
+    QEventLoop waitLoop;
+    app.connect(&startup, SIGNAL(ready()), &waitLoop, SLOT(quit()));
+    app.connect(&startup, SIGNAL(failed()), &waitLoop, SLOT(quit()));
+    startup.start(SETTINGS_TIMEOUT_MS);
+    waitLoop.exec();
+    if (!startup.isReady()) {
         return 1; // Not success
     }
 
-    addSetting("/Settings/TristarMPPT/IPAddress", "", "", "");
-    addSetting("/Settings/TristarMPPT/PortNumber", 502, 0, 0);
-    addSetting("/Settings/TristarMPPT/Interval", 5000, 0, 0);
-    DBusTsmppt a(0);
-
-    app.connect(&a, SIGNAL(terminateApp()), &app, SLOT(quit()));
+    QList<DBusTsmppt *> tsmppts;
+    for (int i = 0; i < controllers; i++) {
+        DBusTsmppt *a = new DBusTsmppt(i);
+        app.connect(a, SIGNAL(terminateApp()), &app, SLOT(quit()));
+        tsmppts.append(a);
+    }
 
-    return app.exec();
+    int result = app.exec();
+    qDeleteAll(tsmppts);
+    return result;
 }
 }
 
@@ -0,0 +1,218 @@
+#include <QsLog.h>
+#include <QTimer>
+#include "modbus_gateway.h"
+#include "modbus_tcp_client.h"
+#include "modbus_unit.h"
+
+// Period of the throughput report
+const int REPORT_PERIOD_MS  = 5 * 60000;
+
+QHash<QString, ModbusGateway *> ModbusGateway::mGateways;
+
+ModbusGateway::ModbusGateway(const QString &host, int port):
+    QObject(0),
+    mKey(host + ":" + QString::number(port)),
+    mRefCount(0),
+    mClient(new ModbusTcpClient(host, port, 1, this)),
+    mNextUnit(0),
+    mScheduling(false),
+    mReportTimer(new QTimer(this)),
+    mReads(0),
+    mRegisters(0)
+{
+    connect(mClient, SIGNAL(readFinished(int, int, QVector<quint16>)),
+            this, SLOT(onReadFinished(int, int, QVector<quint16>)));
+    connect(mClient, SIGNAL(readFailed(int, int, int)), this, SLOT(onReadFailed(int, int, int)));
+    connect(mClient, SIGNAL(connected()), this, SLOT(onConnected()));
+    connect(mReportTimer, SIGNAL(timeout()), this, SLOT(onReportTimeout()));
+    mReportTimer->start(REPORT_PERIOD_MS);
+}
+
+ModbusGateway *ModbusGateway::acquire(const QString &host, int port)
+{
+    QString key = host + ":" + QString::number(port);
+    ModbusGateway *gateway = mGateways.value(key);
+    if (gateway == 0) {
+        gateway = new ModbusGateway(host, port);
+        mGateways.insert(key, gateway);
+    }
+    ++gateway->mRefCount;
+    return gateway;
+}
+
+void ModbusGateway::release()
+{
+    if (--mRefCount > 0)
+        return;
+    mGateways.remove(mKey);
+    mClient->disconnectFromDevice();
+    // May be called from a slot of this gateway
+    deleteLater();
+}
+
+void ModbusGateway::attach(ModbusUnit *unit)
+{
+    if (indexOf(unit) >= 0)
+        return;
+    foreach (const Unit &u, mUnits) {
+        if (u.unit->unitId() == unit->unitId())
+            QLOG_WARN() << "ModbusGateway:" << mKey << "unit" << unit->unitId() << "is polled twice";
+    }
+    Unit u;
+    u.unit = unit;
+    mUnits.append(u);
+    updateConnectTimeout();
+    QLOG_INFO() << "ModbusGateway:" << mKey << "serves" << mUnits.size() << "units";
+}
+
+void ModbusGateway::detach(ModbusUnit *unit)
+{
+    drop(unit);
+    int i = indexOf(unit);
+    if (i < 0)
+        return;
+    mUnits.removeAt(i);
+    if (mNextUnit > i)
+        --mNextUnit;
+    updateConnectTimeout();
+    // The window may have grown
+    schedule();
+}
+
+void ModbusGateway::read(ModbusUnit *unit, int address, int count)
+{
+    int i = indexOf(unit);
+    if (i < 0)
+        return;
+    Read r;
+    r.address = address;
+    r.count = count;
+    mUnits[i].queue.enqueue(r);
+    schedule();
+}
+
+void ModbusGateway::drop(ModbusUnit *unit)
+{
+    int i = indexOf(unit);
+    if (i >= 0)
+        mUnits[i].queue.clear();
+    if (mUnits.size() <= 1) {
+        mClient->disconnectFromDevice();
+        mRequests.clear();
+        return;
+    }
+    // Replies to the outstanding requests of the unit are ignored.
+    QHash<int, ModbusUnit *>::iterator it = mRequests.begin();
+    while (it != mRequests.end()) {
+        if (it.value() == unit)
+            it = mRequests.erase(it);
+        else
+            ++it;
+    }
+}
+
+int ModbusGateway::window() const
+{
+    return mUnits.size() > 1 ? 1 : mClient->window();
+}
+
+int ModbusGateway::unitCount() const
+{
+    return mUnits.size();
+}
+
+void ModbusGateway::updateConnectTimeout()
+{
+    int timeout = 0;
+    foreach (const Unit &u, mUnits)
+        timeout = qMax(timeout, u.unit->responseTimeout());
+    mClient->setConnectTimeout(timeout);
+}
+
+ModbusTcpClient *ModbusGateway::client() const
+{
+    return mClient;
+}
+
+int ModbusGateway::indexOf(const ModbusUnit *unit) const
+{
+    for (int i = 0; i < mUnits.size(); ++i) {
+        if (mUnits[i].unit == unit)
+            return i;
+    }
+    return -1;
+}
+
+void ModbusGateway::schedule()
+{
+    // Signals of the client may call back into read or drop.
+    if (mScheduling)
+        return;
+    mScheduling = true;
+    while (mClient->pendingCount() < window()) {
+        int i = 0;
+        while (i < mUnits.size() && mUnits[(mNextUnit + i) % mUnits.size()].queue.isEmpty())
+            ++i;
+        if (i == mUnits.size())
+            break;
+        int index = (mNextUnit + i) % mUnits.size();
+        mNextUnit = (index + 1) % mUnits.size();
+        Unit &u = mUnits[index];
+        Read r = u.queue.dequeue();
+        int requestId = mClient->readInputRegisters(r.address, r.count, u.unit->unitId(),
+                                                    u.unit->rtt().timeout());
+        if (requestId == -1) {
+            u.unit->failRead(r.address, ModbusTcpClient::ProtocolError, "Invalid read");
+            continue;
+        }
+        mRequests.insert(requestId, u.unit);
+    }
+    mScheduling = false;
+}
+
+void ModbusGateway::onReadFinished(int requestId, int address, const QVector<quint16> &registers)
+{
+    ModbusUnit *unit = mRequests.take(requestId);
+    if (unit != 0) {
+        ++mReads;
+        mRegisters += registers.size();
+        unit->finishRead(address, registers, mClient->lastRoundTripMs());
+    }
+    schedule();
+}
+
+void ModbusGateway::onReadFailed(int requestId, int address, int error)
+{
+    ModbusUnit *unit = mRequests.take(requestId);
+    if (unit != 0)
+        unit->failRead(address, error, mClient->errorString(), mClient->lastRoundTripMs());
+    if (error == ModbusTcpClient::ConnectError) {
+        // The gateway is not reachable, none of the queued reads can succeed.
+        for (int i = 0; i < mUnits.size(); ++i) {
+            while (!mUnits[i].queue.isEmpty()) {
+                Read r = mUnits[i].queue.dequeue();
+                mUnits[i].unit->failRead(r.address, error, mClient->errorString());
+            }
+        }
+    }
+    schedule();
+}
+
+void ModbusGateway::onConnected()
+{
+    foreach (const Unit &u, mUnits)
+        u.unit->notifyConnected();
+}
+
+void ModbusGateway::onReportTimeout()
+{
+    double seconds = REPORT_PERIOD_MS / 1000.0;
+    QLOG_INFO() << "ModbusGateway:" << mKey << mUnits.size() << "units," << mReads / seconds
+                << "reads/s," << mRegisters / seconds << "registers/s, window" << window();
+    foreach (const Unit &u, mUnits) {
+        QLOG_INFO() << "ModbusGateway:" << mKey << "unit" << u.unit->unitId() << "srtt"
+                    << u.unit->rtt().srtt() << "ms, timeout" << u.unit->rtt().timeout() << "ms";
+    }
+    mReads = 0;
+    mRegisters = 0;
+}
@@ -0,0 +1,110 @@
+#ifndef MODBUS_GATEWAY_H
+#define MODBUS_GATEWAY_H
+
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QQueue>
+#include <QString>
+#include <QVector>
+
+class ModbusTcpClient;
+class ModbusUnit;
+class QTimer;
+
+/*!
+ * \brief One Modbus-TCP connection shared by all units at an address.
+ * RS-485 gateways often accept only one or two client sockets, while several
+ * charge controllers (units) sit behind them. All `ModbusUnit` objects with the
+ * same host and port share one gateway, and so one `ModbusTcpClient`.
+ * Each unit has its own queue. Requests are handed to the client in round
+ * robin order over the units with queued requests, so a slow or failing unit
+ * does not starve the others. The bus behind the gateway is half duplex:
+ * while more than one unit is attached only one request is outstanding at a
+ * time, a single unit may use the window of the client.
+ * Every request carries the response timeout of its unit. The connect timeout
+ * is shared by all units: it is the largest response timeout ceiling of the
+ * attached units.
+ * The number of reads and registers per second is logged every few minutes.
+ * Gateways are only used from the acquisition thread.
+ */
+class ModbusGateway : public QObject
+{
+    Q_OBJECT
+public:
+    /*!
+     * \brief Returns the gateway at `host`:`port`, created on first use.
+     * Every call must be matched by a call to `release`.
+     */
+    static ModbusGateway *acquire(const QString &host, int port);
+
+    void release();
+
+    void attach(ModbusUnit *unit);
+    void detach(ModbusUnit *unit);
+
+    /*!
+     * \brief Queues a read for `unit`, reported through the unit's signals.
+     */
+    void read(ModbusUnit *unit, int address, int count);
+
+    /*!
+     * \brief Drops the queued and outstanding reads of `unit`, their results
+     * are not reported. The connection is closed if no other unit uses it.
+     */
+    void drop(ModbusUnit *unit);
+
+    /*!
+     * \brief Number of requests that may be outstanding at the same time.
+     */
+    int window() const;
+
+    int unitCount() const;
+
+    /*!
+     * \brief Sets the connect timeout of the client to the largest response
+     * timeout of the attached units. Called when a unit's timeout changes.
+     */
+    void updateConnectTimeout();
+
+    ModbusTcpClient *client() const;
+
+private slots:
+    void onReadFinished(int requestId, int address, const QVector<quint16> &registers);
+    void onReadFailed(int requestId, int address, int error);
+    void onConnected();
+    void onReportTimeout();
+
+private:
+    struct Read
+    {
+        int address;
+        int count;
+    };
+
+    struct Unit
+    {
+        ModbusUnit *unit;
+        QQueue<Read> queue;
+    };
+
+    ModbusGateway(const QString &host, int port);
+
+    int indexOf(const ModbusUnit *unit) const;
+    void schedule();
+
+    QString mKey;
+    int mRefCount;
+    ModbusTcpClient *mClient;
+    QList<Unit> mUnits;
+    int mNextUnit;
+    QHash<int, ModbusUnit *> mRequests;     // Request ID to unit
+    bool mScheduling;
+    QTimer *mReportTimer;
+    int mReads;
+    qint64 mRegisters;
+
+    static QHash<QString, ModbusGateway *> mGateways;
+};
+
+#endif // MODBUS_GATEWAY_H
@@ -0,0 +1,504 @@
+#include <string.h>
+#ifdef Q_OS_LINUX
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#endif
+#include <QsLog.h>
+#include <QTcpSocket>
+#include <QTimer>
+#include "host_resolver.h"
+#include "modbus_tcp_client.h"
+
+// MBAP header: transaction id (2), protocol id (2), length (2), unit id (1)
+const int MBAP_HEADER_SIZE      = 7;
+// Largest Modbus-TCP ADU: MBAP header + 253 bytes PDU
+const int MAX_ADU_SIZE          = 260;
+const int MAX_READ_REGISTERS    = 125;
+const int READ_REQUEST_SIZE     = MBAP_HEADER_SIZE + 5;
+
+const quint8 FC_READ_INPUT_REGISTERS = 0x04;
+const quint8 FC_EXCEPTION_FLAG       = 0x80;
+
+// Keepalive probing: first probe after 10 s idle, then every 5 s, give up
+// after 3 unanswered probes. Unacknowledged data fails the socket after 30 s.
+const int KEEPALIVE_IDLE_S      = 10;
+const int KEEPALIVE_INTERVAL_S  = 5;
+const int KEEPALIVE_COUNT       = 3;
+const int TCP_USER_TIMEOUT_MS   = 30000;
+
+const int DEFAULT_CONNECT_TIMEOUT_MS    = 5000;
+
+// Outstanding requests per connection, a Modbus-TCP server must accept at
+// least one.
+const int MAX_WINDOW            = 16;
+
+int ModbusTcpClient::mDefaultWindow = 4;
+
+static inline quint16 getWord(const uchar *p)
+{
+    return (quint16)((p[0] << 8) | p[1]);
+}
+
+static inline void putWord(char *p, quint16 v)
+{
+    p[0] = (char)(v >> 8);
+    p[1] = (char)(v & 0xff);
+}
+
+ModbusTcpClient::ModbusTcpClient(const QString &host, int port, int unitId, QObject *parent):
+    QObject(parent),
+    mSocket(new QTcpSocket(this)),
+    mResolver(new HostResolver(this)),
+    mResolving(false),
+    mLookedUp(false),
+    mSendQueued(false),
+    mResponseTimer(new QTimer(this)),
+    mHost(host),
+    mPort(port),
+    mUnitId(unitId),
+    mConnectTimeout(DEFAULT_CONNECT_TIMEOUT_MS),
+    mNextTransactionId(0),
+    mWindow(mDefaultWindow),
+    mRxLength(0),
+    mLastReplyMs(-1),
+    mRoundTripMs(-1),
+    mFreshConnection(false)
+{
+    memset(&mStatistics, 0, sizeof(mStatistics));
+    mTxFrame.resize(READ_REQUEST_SIZE);
+    mRxBuffer.resize(2 * MAX_ADU_SIZE);
+    mRegisters.reserve(MAX_READ_REGISTERS);
+    mClock.start();
+
+    mResponseTimer->setSingleShot(true);
+    connect(mResponseTimer, SIGNAL(timeout()), this, SLOT(onResponseTimeout()));
+    connect(mResolver, SIGNAL(finished()), this, SLOT(onHostLookedUp()));
+
+    connect(mSocket, SIGNAL(connected()), this, SLOT(onConnected()));
+    connect(mSocket, SIGNAL(disconnected()), this, SLOT(onDisconnected()));
+    connect(mSocket, SIGNAL(error(QAbstractSocket::SocketError)),
+            this, SLOT(onSocketError(QAbstractSocket::SocketError)));
+    connect(mSocket, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
+}
+
+void ModbusTcpClient::setConnectTimeout(int ms)
+{
+    if (ms > 0)
+        mConnectTimeout = ms;
+}
+
+int ModbusTcpClient::connectTimeout() const
+{
+    return mConnectTimeout;
+}
+
+void ModbusTcpClient::disconnectFromDevice()
+{
+    mResponseTimer->stop();
+    // A lookup in progress is not aborted, its result is still cached.
+    mResolving = false;
+    mQueue.clear();
+    mOutstanding.clear();
+    mRxLength = 0;
+    mSocket->abort();
+}
+
+int ModbusTcpClient::window() const
+{
+    return mWindow;
+}
+
+void ModbusTcpClient::setDefaultWindow(int window)
+{
+    mDefaultWindow = qBound(1, window, MAX_WINDOW);
+}
+
+int ModbusTcpClient::readInputRegisters(int address, int count, int unitId, int timeoutMs)
+{
+    if (count < 1 || count > MAX_READ_REGISTERS || address < 0 ||
+            address + count > 0x10000) {
+        QLOG_ERROR() << "ModbusTcpClient: invalid read of" << count
+                     << "registers at" << address;
+        return -1;
+    }
+    Request r;
+    r.transactionId = ++mNextTransactionId;
+    r.address = address;
+    r.count = count;
+    r.unitId = unitId < 0 ? mUnitId : (quint8)unitId;
+    r.timeoutMs = timeoutMs > 0 ? timeoutMs : mConnectTimeout;
+    mQueue.enqueue(r);
+    // Sent from the event loop: the caller gets the request ID before any
+    // signal, and the requests queued in one go are written together.
+    if (!mSendQueued) {
+        mSendQueued = true;
+        QMetaObject::invokeMethod(this, "onSendQueued", Qt::QueuedConnection);
+    }
+    return r.transactionId;
+}
+
+int ModbusTcpClient::pendingCount() const
+{
+    return mQueue.size() + mOutstanding.size();
+}
+
+QString ModbusTcpClient::errorString() const
+{
+    return mErrorString;
+}
+
+const ModbusTcpClient::Statistics &ModbusTcpClient::statistics() const
+{
+    return mStatistics;
+}
+
+int ModbusTcpClient::lastRoundTripMs() const
+{
+    return mRoundTripMs;
+}
+
+QString ModbusTcpClient::host() const
+{
+    return mHost;
+}
+
+int ModbusTcpClient::port() const
+{
+    return mPort;
+}
+
+double ModbusTcpClient::Statistics::reuseRatio() const
+{
+    return requests == 0 ? 0.0 : (double)reusedRequests / requests;
+}
+
+double ModbusTcpClient::Statistics::averageHandshakeMs() const
+{
+    return connects == 0 ? 0.0 : (double)totalHandshakeMs / connects;
+}
+
+double ModbusTcpClient::Statistics::averageLookupMs() const
+{
+    return lookups == 0 ? 0.0 : (double)totalLookupMs / lookups;
+}
+
+void ModbusTcpClient::onConnected()
+{
+    mResponseTimer->stop();
+    int handshakeMs = mHandshakeTimer.elapsed();
+    mStatistics.connects++;
+    mStatistics.lastHandshakeMs = handshakeMs;
+    mStatistics.totalHandshakeMs += handshakeMs;
+    mFreshConnection = true;
+    enableKeepAlive();
+    emit connected();
+    sendNext();
+}
+
+void ModbusTcpClient::onDisconnected()
+{
+    if (mOutstanding.size() > 1)
+        fallBackToSingleRequests("closed the connection");
+    failAll(SocketError, "Connection closed by peer");
+}
+
+void ModbusTcpClient::onSocketError(QAbstractSocket::SocketError)
+{
+    QString message = mSocket->errorString();
+    bool wasConnected = mSocket->state() == QAbstractSocket::ConnectedState;
+    abortSocket();
+    if (wasConnected && mOutstanding.size() > 1)
+        fallBackToSingleRequests("dropped the connection");
+    // The device may have moved, look it up again on the next connect.
+    if (!wasConnected)
+        HostResolver::forget(mHost);
+    failAll(wasConnected ? SocketError : ConnectError, message);
+}
+
+void ModbusTcpClient::onReadyRead()
+{
+    qint64 n = mSocket->read(mRxBuffer.data() + mRxLength, mRxBuffer.size() - mRxLength);
+    if (n <= 0)
+        return;
+    mRxLength += n;
+
+    int offset = 0;
+    while (mRxLength - offset >= MBAP_HEADER_SIZE) {
+        const uchar *frame = reinterpret_cast<const uchar *>(mRxBuffer.constData()) + offset;
+        int length = getWord(frame + 4);
+        if (getWord(frame + 2) != 0 || length < 2 || length > MAX_ADU_SIZE - 6) {
+            QLOG_ERROR() << "ModbusTcpClient: invalid MBAP header, dropping connection";
+            abortSocket();
+            failAll(ProtocolError, "Invalid MBAP header");
+            return;
+        }
+        int frameSize = 6 + length;
+        if (mRxLength - offset < frameSize)
+            break;
+        offset += frameSize;
+        processFrame(frame, frameSize);
+        // processFrame may have closed the connection and reset the buffer
+        if (offset > mRxLength)
+            return;
+    }
+    if (offset > 0) {
+        mRxLength -= offset;
+        memmove(mRxBuffer.data(), mRxBuffer.constData() + offset, mRxLength);
+    }
+    // More data may be pending if the buffer was full
+    if (mSocket->bytesAvailable() > 0)
+        QTimer::singleShot(0, this, SLOT(onReadyRead()));
+}
+
+void ModbusTcpClient::onResponseTimeout()
+{
+    if (mResolving) {
+        // The lookup continues in the background and fills the cache.
+        mResolving = false;
+        failAll(ConnectError, QString("Lookup of %1 timed out").arg(mHost));
+        return;
+    }
+    if (mSocket->state() != QAbstractSocket::ConnectedState) {
+        abortSocket();
+        HostResolver::forget(mHost);
+        failAll(ConnectError, "Connection timed out");
+        return;
+    }
+    qint64 now = mClock.elapsed();
+    int expired = -1;
+    for (int i = 0; i < mOutstanding.size(); ++i) {
+        if (mOutstanding[i].deadlineMs <= now) {
+            expired = i;
+            break;
+        }
+    }
+    if (expired == -1) {
+        startResponseTimer();
+        return;
+    }
+    // The device answered a later request, but not this one: it drops
+    // requests sent while another is outstanding. Send them again, one by one.
+    if (mOutstanding.size() > 1 && mLastReplyMs >= mOutstanding[expired].sentMs) {
+        fallBackToSingleRequests("does not answer all outstanding requests");
+        for (int i = mOutstanding.size() - 1; i >= 0; --i)
+            mQueue.prepend(mOutstanding[i].request);
+        mOutstanding.clear();
+        sendNext();
+        return;
+    }
+    // A late reply will be dropped because its transaction ID is no longer
+    // outstanding. The other requests keep their own deadlines.
+    Outstanding o = mOutstanding.takeAt(expired);
+    mStatistics.timeouts++;
+    failRequest(o.request, TimeoutError,
+                QString("Response timed out after %1 ms").arg(o.deadlineMs - o.sentMs));
+}
+
+void ModbusTcpClient::onHostLookedUp()
+{
+    mResponseTimer->stop();
+    mResolving = false;
+    mLookedUp = !mQueue.isEmpty();
+    int lookupMs = mResolver->lastLookupMs();
+    mStatistics.lookups++;
+    mStatistics.lastLookupMs = lookupMs;
+    mStatistics.totalLookupMs += lookupMs;
+    // Connects to the new address, or fails the queue from the cache
+    sendNext();
+}
+
+void ModbusTcpClient::onSendQueued()
+{
+    mSendQueued = false;
+    sendNext();
+}
+
+void ModbusTcpClient::abortSocket()
+{
+    // Do not report the disconnect caused by the abort itself
+    mSocket->blockSignals(true);
+    mSocket->abort();
+    mSocket->blockSignals(false);
+    mRxLength = 0;
+}
+
+void ModbusTcpClient::enableKeepAlive()
+{
+    mSocket->setSocketOption(QAbstractSocket::KeepAliveOption, 1);
+    mSocket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+#ifdef Q_OS_LINUX
+    int fd = mSocket->socketDescriptor();
+    if (fd == -1)
+        return;
+    int idle = KEEPALIVE_IDLE_S;
+    int interval = KEEPALIVE_INTERVAL_S;
+    int count = KEEPALIVE_COUNT;
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval));
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof(count));
+#ifdef TCP_USER_TIMEOUT
+    unsigned int userTimeout = TCP_USER_TIMEOUT_MS;
+    setsockopt(fd, IPPROTO_TCP, TCP_USER_TIMEOUT, &userTimeout, sizeof(userTimeout));
+#endif
+#endif
+}
+
+void ModbusTcpClient::sendNext()
+{
+    if (mQueue.isEmpty() || mOutstanding.size() >= mWindow)
+        return;
+    switch (mSocket->state()) {
+    case QAbstractSocket::UnconnectedState:
+    {
+        if (mResolving)
+            return;
+        bool lookedUp = mLookedUp;
+        mLookedUp = false;
+        QHostAddress address;
+        switch (mResolver->resolve(mHost, address)) {
+        case HostResolver::Pending:
+            // onHostLookedUp will resume.
+            mResolving = true;
+            mResponseTimer->start(mConnectTimeout);
+            return;
+        case HostResolver::Failed:
+            failAll(ConnectError, mResolver->errorString());
+            return;
+        case HostResolver::Resolved:
+            break;
+        }
+        if (!lookedUp)
+            mStatistics.cachedLookups++;
+        mRxLength = 0;
+        mLastReplyMs = -1;
+        mHandshakeTimer.start();
+        mSocket->connectToHost(address, mPort);
+        mResponseTimer->start(mConnectTimeout);
+        return;
+    }
+    case QAbstractSocket::ConnectedState:
+        break;
+    default:
+        // Still connecting, onConnected will resume.
+        return;
+    }
+
+    while (!mQueue.isEmpty() && mOutstanding.size() < mWindow)
+        sendRequest(mQueue.dequeue());
+    startResponseTimer();
+}
+
+void ModbusTcpClient::sendRequest(const Request &r)
+{
+    char *p = mTxFrame.data();
+    putWord(p, r.transactionId);
+    putWord(p + 2, 0);
+    putWord(p + 4, 6);
+    p[6] = (char)r.unitId;
+    p[7] = (char)FC_READ_INPUT_REGISTERS;
+    putWord(p + 8, r.address);
+    putWord(p + 10, r.count);
+    mStatistics.requests++;
+    if (!mFreshConnection)
+        mStatistics.reusedRequests++;
+    if (!mOutstanding.isEmpty())
+        mStatistics.pipelinedRequests++;
+    mFreshConnection = false;
+    Outstanding o;
+    o.request = r;
+    o.sentMs = mClock.elapsed();
+    o.deadlineMs = o.sentMs + r.timeoutMs;
+    mOutstanding.append(o);
+    // The socket copies the frame, the buffer is reused for the next one.
+    mSocket->write(mTxFrame.constData(), READ_REQUEST_SIZE);
+}
+
+void ModbusTcpClient::startResponseTimer()
+{
+    if (mOutstanding.isEmpty()) {
+        mResponseTimer->stop();
+        return;
+    }
+    qint64 deadline = mOutstanding.first().deadlineMs;
+    foreach (const Outstanding &o, mOutstanding)
+        deadline = qMin(deadline, o.deadlineMs);
+    qint64 wait = deadline - mClock.elapsed();
+    mResponseTimer->start(wait > 0 ? (int)wait : 0);
+}
+
+void ModbusTcpClient::fallBackToSingleRequests(const QString &reason)
+{
+    if (mWindow == 1)
+        return;
+    QLOG_WARN() << "ModbusTcpClient:" << mHost << reason << "with" << mOutstanding.size()
+                << "outstanding requests, sending one request at a time";
+    mWindow = 1;
+}
+
+void ModbusTcpClient::processFrame(const uchar *frame, int length)
+{
+    quint16 transactionId = getWord(frame);
+    int index = 0;
+    while (index < mOutstanding.size() && mOutstanding[index].request.transactionId != transactionId)
+        ++index;
+    if (index == mOutstanding.size()) {
+        QLOG_DEBUG() << "ModbusTcpClient: dropping reply with transaction ID" << transactionId;
+        return;
+    }
+    Outstanding o = mOutstanding.takeAt(index);
+    const Request &r = o.request;
+    mLastReplyMs = mClock.elapsed();
+    // Also exceptions and malformed replies show how fast the device answers
+    mRoundTripMs = mLastReplyMs - o.sentMs;
+    quint8 function = frame[7];
+    if (function == (FC_READ_INPUT_REGISTERS | FC_EXCEPTION_FLAG)) {
+        int code = length > 8 ? frame[8] : 0;
+        failRequest(r, ExceptionError, QString("Modbus exception %1").arg(code));
+        return;
+    }
+    int byteCount = length > 8 ? frame[8] : -1;
+    if (function != FC_READ_INPUT_REGISTERS || byteCount != 2 * r.count ||
+            length != 9 + byteCount) {
+        failRequest(r, ProtocolError, "Unexpected reply");
+        return;
+    }
+    mRegisters.resize(r.count);
+    const uchar *data = frame + 9;
+    for (int i = 0; i < r.count; ++i, data += 2)
+        mRegisters[i] = getWord(data);
+    completeRequest(r);
+}
+
+void ModbusTcpClient::completeRequest(const Request &r)
+{
+    startResponseTimer();
+    emit readFinished(r.transactionId, r.address, mRegisters);
+    mRoundTripMs = -1;
+    sendNext();
+}
+
+void ModbusTcpClient::failRequest(const Request &r, Error error, const QString &message)
+{
+    startResponseTimer();
+    mErrorString = message;
+    emit readFailed(r.transactionId, r.address, error);
+    mRoundTripMs = -1;
+    sendNext();
+}
+
+void ModbusTcpClient::failAll(Error error, const QString &message)
+{
+    mResponseTimer->stop();
+    if (mQueue.isEmpty() && mOutstanding.isEmpty())
+        return;
+    QList<Request> failed;
+    foreach (const Outstanding &o, mOutstanding)
+        failed.append(o.request);
+    failed += mQueue;
+    mOutstanding.clear();
+    mQueue.clear();
+    mErrorString = message;
+    foreach (const Request &r, failed)
+        emit readFailed(r.transactionId, r.address, error);
+}
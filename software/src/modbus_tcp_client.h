@@ -0,0 +1,215 @@
+#ifndef MODBUS_TCP_CLIENT_H
+#define MODBUS_TCP_CLIENT_H
+
+#include <QAbstractSocket>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QList>
+#include <QObject>
+#include <QQueue>
+#include <QString>
+#include <QVector>
+
+class HostResolver;
+class QTcpSocket;
+class QTimer;
+
+/*!
+ * \brief Event driven Modbus-TCP client.
+ * Requests are queued and sent over a QTcpSocket. Up to `window` requests are
+ * outstanding at the same time, each with its own timeout. Replies are matched
+ * to their request by the MBAP transaction ID, in any order, and reported
+ * through the `readFinished` and `readFailed` signals, so the caller never
+ * blocks while waiting for the device. When a device (or gateway) answers
+ * only some of several outstanding requests, or drops the connection, the
+ * client falls back to one request at a time and sends the unanswered
+ * requests again.
+ * The socket is opened on demand when a request is queued while the client is
+ * not connected, and then kept open across requests. TCP keepalive and a TCP
+ * user timeout are enabled so a half-open connection is detected and reported
+ * as `SocketError`; the next request will reconnect. All frames are built and
+ * parsed in buffers allocated once in the constructor.
+ * The time to wait for a reply is passed with each request, so units sharing
+ * the client (see `ModbusGateway`) keep their own timeouts. The round trip
+ * time of the request being reported is available from `lastRoundTripMs`.
+ * A host name is resolved by `HostResolver` before connecting, so a slow or
+ * missing DNS server never blocks the thread, and reconnects use the cached
+ * address.
+ */
+class ModbusTcpClient : public QObject
+{
+    Q_OBJECT
+public:
+    enum Error {
+        NoError,
+        ConnectError,       // Could not establish the TCP connection
+        SocketError,        // Established connection was lost
+        TimeoutError,       // No reply within the response timeout
+        ExceptionError,     // Device replied with a Modbus exception
+        ProtocolError       // Malformed or unexpected reply
+    };
+
+    struct Statistics
+    {
+        int connects;           // Successful TCP handshakes
+        int requests;           // Requests sent
+        int reusedRequests;     // Requests sent on an already used connection
+        int timeouts;           // Requests without a reply in time
+        int pipelinedRequests;  // Requests sent while another was outstanding
+        int lastHandshakeMs;
+        qint64 totalHandshakeMs;
+        int lookups;            // Completed host name lookups
+        int cachedLookups;      // Connects to a cached (or literal) address
+        int lastLookupMs;
+        qint64 totalLookupMs;
+
+        double reuseRatio() const;
+        double averageHandshakeMs() const;
+        double averageLookupMs() const;
+    };
+
+    ModbusTcpClient(const QString &host, int port, int unitId, QObject *parent = 0);
+
+    /*!
+     * \brief Sets the time to wait for a host name lookup or a connection, in
+     * ms. Also used for requests queued without a timeout.
+     */
+    void setConnectTimeout(int ms);
+    int connectTimeout() const;
+
+    /*!
+     * \brief Number of requests that may be outstanding at the same time.
+     */
+    int window() const;
+
+    /*!
+     * \brief Sets the window of all clients created afterwards (default 4).
+     */
+    static void setDefaultWindow(int window);
+
+    /*!
+     * \brief Closes the connection. Queued requests are dropped without
+     * further notification.
+     */
+    void disconnectFromDevice();
+
+    /*!
+     * \brief Queues a Read Input Registers (function 0x04) request.
+     * \param address The first register to read.
+     * \param count The number of registers (1..125).
+     * \param unitId The unit (slave) to read from, -1 for the unit passed to
+     * the constructor. Several units behind a gateway can share one client.
+     * \param timeoutMs The time to wait for the reply, -1 for the connect
+     * timeout.
+     * \return An identifier passed to `readFinished` or `readFailed` once the
+     * request completes, or -1 if the request is invalid. The signals are
+     * never emitted before this function returns.
+     */
+    int readInputRegisters(int address, int count, int unitId = -1, int timeoutMs = -1);
+
+    /*!
+     * \brief Number of requests queued or outstanding.
+     */
+    int pendingCount() const;
+
+    /*!
+     * \brief Returns a description of the last error.
+     */
+    QString errorString() const;
+
+    const Statistics &statistics() const;
+
+    /*!
+     * \brief Round trip time of the request reported by the `readFinished` or
+     * `readFailed` signal being emitted, in ms. -1 if the device did not reply,
+     * for example after a timeout or a lost connection.
+     */
+    int lastRoundTripMs() const;
+
+    QString host() const;
+    int port() const;
+
+signals:
+    /*!
+     * \brief Emitted after a new TCP connection has been established.
+     */
+    void connected();
+
+    /*!
+     * \brief Emitted when a read completes. `registers` refers to an internal
+     * buffer and is only valid during the signal emission.
+     */
+    void readFinished(int requestId, int address, const QVector<quint16> &registers);
+
+    /*!
+     * \brief Emitted when a read fails. `error` is one of `Error`.
+     */
+    void readFailed(int requestId, int address, int error);
+
+private slots:
+    void onConnected();
+    void onDisconnected();
+    void onSocketError(QAbstractSocket::SocketError error);
+    void onReadyRead();
+    void onResponseTimeout();
+    void onHostLookedUp();
+    void onSendQueued();
+
+private:
+    struct Request
+    {
+        quint16 transactionId;
+        quint16 address;
+        quint16 count;
+        quint8 unitId;
+        int timeoutMs;
+    };
+
+    struct Outstanding
+    {
+        Request request;
+        qint64 sentMs;
+        qint64 deadlineMs;
+    };
+
+    void abortSocket();
+    void enableKeepAlive();
+    void sendNext();
+    void sendRequest(const Request &r);
+    void startResponseTimer();
+    void fallBackToSingleRequests(const QString &reason);
+    void processFrame(const uchar *frame, int length);
+    void completeRequest(const Request &r);
+    void failRequest(const Request &r, Error error, const QString &message);
+    void failAll(Error error, const QString &message);
+
+    QTcpSocket *mSocket;
+    HostResolver *mResolver;
+    bool mResolving;
+    bool mLookedUp;
+    bool mSendQueued;
+    QTimer *mResponseTimer;
+    QString mHost;
+    int mPort;
+    quint8 mUnitId;
+    int mConnectTimeout;
+    quint16 mNextTransactionId;
+    QQueue<Request> mQueue;             // Not sent yet
+    QList<Outstanding> mOutstanding;    // Sent, in order
+    int mWindow;
+    QByteArray mTxFrame;
+    QByteArray mRxBuffer;
+    int mRxLength;
+    QVector<quint16> mRegisters;
+    QString mErrorString;
+    QElapsedTimer mHandshakeTimer;
+    QElapsedTimer mClock;
+    qint64 mLastReplyMs;
+    int mRoundTripMs;
+    bool mFreshConnection;
+    Statistics mStatistics;
+
+    static int mDefaultWindow;
+};
+
+#endif // MODBUS_TCP_CLIENT_H
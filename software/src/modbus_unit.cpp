@@ -0,0 +1,131 @@
+#include "modbus_gateway.h"
+#include "modbus_unit.h"
+
+// Bounds of the reply timeout. The lower bound covers the processing time of
+// the controller, the upper bound is changed with setResponseTimeout.
+const int MIN_RESPONSE_TIMEOUT_MS       = 250;
+const int DEFAULT_RESPONSE_TIMEOUT_MS   = 5000;
+
+ModbusUnit::ModbusUnit(const QString &host, int port, int unitId, QObject *parent):
+    QObject(parent),
+    mHost(host),
+    mPort(port),
+    mUnitId(unitId),
+    mRtt(MIN_RESPONSE_TIMEOUT_MS, DEFAULT_RESPONSE_TIMEOUT_MS),
+    mGateway(0)
+{
+}
+
+ModbusUnit::~ModbusUnit()
+{
+    detach();
+}
+
+void ModbusUnit::readInputRegisters(int address, int count)
+{
+    gateway()->read(this, address, count);
+}
+
+void ModbusUnit::disconnectFromDevice()
+{
+    if (mGateway != 0)
+        mGateway->drop(this);
+}
+
+void ModbusUnit::setTarget(const QString &host, int port, int unitId)
+{
+    if (host == mHost && port == mPort && unitId == mUnitId)
+        return;
+    detach();
+    mHost = host;
+    mPort = port;
+    mUnitId = unitId;
+}
+
+void ModbusUnit::setResponseTimeout(int ms)
+{
+    mRtt.setMaxTimeout(ms);
+    if (mGateway != 0)
+        mGateway->updateConnectTimeout();
+}
+
+int ModbusUnit::responseTimeout() const
+{
+    return mRtt.maxTimeout();
+}
+
+QString ModbusUnit::host() const
+{
+    return mHost;
+}
+
+int ModbusUnit::port() const
+{
+    return mPort;
+}
+
+int ModbusUnit::unitId() const
+{
+    return mUnitId;
+}
+
+QString ModbusUnit::errorString() const
+{
+    return mErrorString;
+}
+
+int ModbusUnit::window() const
+{
+    return mGateway != 0 ? mGateway->window() : 1;
+}
+
+const ModbusTcpClient::Statistics &ModbusUnit::statistics() const
+{
+    static const ModbusTcpClient::Statistics none = ModbusTcpClient::Statistics();
+    return mGateway != 0 ? mGateway->client()->statistics() : none;
+}
+
+const RttEstimator &ModbusUnit::rtt() const
+{
+    return mRtt;
+}
+
+ModbusGateway *ModbusUnit::gateway()
+{
+    if (mGateway == 0) {
+        mGateway = ModbusGateway::acquire(mHost, mPort);
+        mGateway->attach(this);
+    }
+    return mGateway;
+}
+
+void ModbusUnit::detach()
+{
+    if (mGateway == 0)
+        return;
+    mGateway->detach(this);
+    mGateway->release();
+    mGateway = 0;
+}
+
+void ModbusUnit::finishRead(int address, const QVector<quint16> &registers, int roundTripMs)
+{
+    mRtt.addSample(roundTripMs);
+    emit readFinished(address, registers);
+}
+
+void ModbusUnit::failRead(int address, int error, const QString &message, int roundTripMs)
+{
+    // Also exceptions and malformed replies show how fast the unit answers
+    if (roundTripMs >= 0)
+        mRtt.addSample(roundTripMs);
+    else if (error == ModbusTcpClient::TimeoutError)
+        mRtt.backOff();
+    mErrorString = message;
+    emit readFailed(address, error);
+}
+
+void ModbusUnit::notifyConnected()
+{
+    emit connected();
+}
@@ -0,0 +1,93 @@
+#ifndef MODBUS_UNIT_H
+#define MODBUS_UNIT_H
+
+#include <QObject>
+#include <QString>
+#include <QVector>
+#include "modbus_tcp_client.h"
+#include "rtt_estimator.h"
+
+class ModbusGateway;
+
+/*!
+ * \brief Reads the registers of one Modbus unit (slave) at an address.
+ * The requests are sent through the `ModbusGateway` of the address, which may
+ * be shared with other units. The gateway is attached on the first read, so
+ * a unit can be created in one thread and used in another.
+ * The results of the reads of this unit are reported through `readFinished`
+ * and `readFailed`; `disconnectFromDevice` only affects the other units if
+ * the connection has to be closed.
+ * Each unit measures its own round trip times and derives the timeout of its
+ * requests from them, so a unit that stopped answering does not lengthen the
+ * timeouts of the other units on the gateway.
+ */
+class ModbusUnit : public QObject
+{
+    Q_OBJECT
+public:
+    ModbusUnit(const QString &host, int port, int unitId, QObject *parent = 0);
+    ~ModbusUnit();
+
+    /*!
+     * \brief Queues a Read Input Registers request, see
+     * `ModbusTcpClient::readInputRegisters`.
+     */
+    void readInputRegisters(int address, int count);
+
+    /*!
+     * \brief Drops the reads in progress, without further notification.
+     */
+    void disconnectFromDevice();
+
+    /*!
+     * \brief Reads from another unit or address from now on.
+     */
+    void setTarget(const QString &host, int port, int unitId);
+
+    /*!
+     * \brief Sets the ceiling of the response timeout of this unit, in ms.
+     * The connect timeout of the gateway is the largest ceiling of its units.
+     */
+    void setResponseTimeout(int ms);
+    int responseTimeout() const;
+
+    QString host() const;
+    int port() const;
+    int unitId() const;
+    QString errorString() const;
+    int window() const;
+
+    /*!
+     * \brief Statistics of the shared connection.
+     */
+    const ModbusTcpClient::Statistics &statistics() const;
+
+    /*!
+     * \brief Round trip times of the requests to this unit.
+     */
+    const RttEstimator &rtt() const;
+
+signals:
+    void connected();
+    void readFinished(int address, const QVector<quint16> &registers);
+    void readFailed(int address, int error);
+
+private:
+    friend class ModbusGateway;
+
+    ModbusGateway *gateway();
+    void detach();
+    // Called by the gateway:
+    void finishRead(int address, const QVector<quint16> &registers, int roundTripMs);
+    void failRead(int address, int error, const QString &message, int roundTripMs = -1);
+    void notifyConnected();
+
+    QString mHost;
+    int mPort;
+    int mUnitId;
+    RttEstimator mRtt;
+    QString mErrorString;
+    ModbusGateway *mGateway;
+};
+
+#endif // MODBUS_UNIT_H
@@ -0,0 +1,47 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "process_stats.h"
+
+long residentMemoryKb()
+{
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (f == 0)
+        return -1;
+    long size = 0;
+    long resident = 0;
+    int n = fscanf(f, "%ld %ld", &size, &resident);
+    fclose(f);
+    if (n != 2)
+        return -1;
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+long processAgeMs()
+{
+    // Field 22 of /proc/self/stat is the start time in clock ticks since boot.
+    // The command name (field 2) may contain spaces, so parse after its ')'.
+    char buffer[1024];
+    FILE *f = fopen("/proc/self/stat", "r");
+    if (f == 0)
+        return -1;
+    size_t length = fread(buffer, 1, sizeof(buffer) - 1, f);
+    fclose(f);
+    buffer[length] = 0;
+    const char *p = strrchr(buffer, ')');
+    unsigned long long startTicks = 0;
+    if (p == 0 || sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %*u %*u "
+                         "%*d %*d %*d %*d %*d %*d %llu", &startTicks) != 1)
+        return -1;
+
+    f = fopen("/proc/uptime", "r");
+    if (f == 0)
+        return -1;
+    double uptime = 0;
+    int n = fscanf(f, "%lf", &uptime);
+    fclose(f);
+    if (n != 1)
+        return -1;
+    long ticksPerSecond = sysconf(_SC_CLK_TCK);
+    return (long)(uptime * 1000.0) - (long)(startTicks * 1000 / ticksPerSecond);
+}
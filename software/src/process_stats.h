@@ -0,0 +1,16 @@
+#ifndef PROCESS_STATS_H
+#define PROCESS_STATS_H
+
+/*!
+ * \brief Returns the resident set size of this process in kB, or -1 if it
+ * cannot be determined.
+ */
+long residentMemoryKb();
+
+/*!
+ * \brief Returns the time since this process was started (exec) in ms, or -1
+ * if it cannot be determined.
+ */
+long processAgeMs();
+
+#endif // PROCESS_STATS_H
@@ -0,0 +1,83 @@
+#include <math.h>
+#include <QtGlobal>
+#include "publish_policy.h"
+
+PublishPolicy::PublishPolicy():
+    mQuantum(0),
+    mAbsoluteDeadband(0),
+    mRelativeDeadband(0),
+    mMinInterval(0),
+    mMaxStaleness(0)
+{
+}
+
+PublishPolicy PublishPolicy::forPrecision(int precision)
+{
+    PublishPolicy policy;
+    if (precision >= 0)
+        policy.setQuantum(pow(10.0, -precision));
+    return policy;
+}
+
+PublishPolicy &PublishPolicy::setQuantum(double quantum)
+{
+    mQuantum = qMax(0.0, quantum);
+    return *this;
+}
+
+PublishPolicy &PublishPolicy::setDeadband(double absolute, double relative)
+{
+    mAbsoluteDeadband = qMax(0.0, absolute);
+    mRelativeDeadband = qMax(0.0, relative);
+    return *this;
+}
+
+PublishPolicy &PublishPolicy::setMinInterval(int ms)
+{
+    mMinInterval = qMax(0, ms);
+    return *this;
+}
+
+PublishPolicy &PublishPolicy::setMaxStaleness(int ms)
+{
+    mMaxStaleness = qMax(0, ms);
+    return *this;
+}
+
+double PublishPolicy::quantum() const
+{
+    return mQuantum;
+}
+
+double PublishPolicy::absoluteDeadband() const
+{
+    return mAbsoluteDeadband;
+}
+
+double PublishPolicy::relativeDeadband() const
+{
+    return mRelativeDeadband;
+}
+
+int PublishPolicy::minInterval() const
+{
+    return mMinInterval;
+}
+
+int PublishPolicy::maxStaleness() const
+{
+    return mMaxStaleness;
+}
+
+bool PublishPolicy::isSignificant(double published, double value) const
+{
+    if (value == published)
+        return false;
+    // NaN and infinity are always published
+    if (isnan(value) || isnan(published) || isinf(value) || isinf(published))
+        return true;
+    if (mQuantum > 0 && floor(value / mQuantum + 0.5) == floor(published / mQuantum + 0.5))
+        return false;
+    double band = qMax(mAbsoluteDeadband, mRelativeDeadband * fabs(published));
+    return fabs(value - published) > band;
+}
@@ -0,0 +1,57 @@
+#ifndef PUBLISH_POLICY_H
+#define PUBLISH_POLICY_H
+
+/*!
+ * \brief Decides when a changed value is published on the D-Bus.
+ * A default constructed policy publishes every change immediately. The
+ * following can be combined:
+ * - A quantum: changes which do not change the value rounded to a multiple of
+ *   the quantum are not published. `forPrecision` uses the resolution of the
+ *   displayed text, so jitter below the displayed precision is suppressed
+ *   without changing what the GUI shows.
+ * - An absolute and/or relative deadband: changes up to the (largest) deadband
+ *   are not published.
+ * - A minimum interval between two publishes. A significant change within the
+ *   interval is published when the interval has elapsed.
+ * - A maximum staleness: after this time the value is published again, even
+ *   when unchanged, so subscribers converge on the latest value. The bridge
+ *   rounds the deadline down to a 1 s tick, so items that go stale together
+ *   are announced in one ItemsChanged message.
+ * The policy only applies to floating point values.
+ */
+class PublishPolicy
+{
+public:
+    PublishPolicy();
+
+    /*!
+     * \brief Policy suppressing changes not visible with `precision` decimals.
+     */
+    static PublishPolicy forPrecision(int precision);
+
+    PublishPolicy &setQuantum(double quantum);
+    PublishPolicy &setDeadband(double absolute, double relative = 0);
+    PublishPolicy &setMinInterval(int ms);
+    PublishPolicy &setMaxStaleness(int ms);
+
+    double quantum() const;
+    double absoluteDeadband() const;
+    double relativeDeadband() const;
+    int minInterval() const;
+    int maxStaleness() const;
+
+    /*!
+     * \brief Returns true if the change from `published` to `value` should be
+     * published.
+     */
+    bool isSignificant(double published, double value) const;
+
+private:
+    double mQuantum;
+    double mAbsoluteDeadband;
+    double mRelativeDeadband;
+    int mMinInterval;
+    int mMaxStaleness;
+};
+
+#endif // PUBLISH_POLICY_H
@@ -0,0 +1,44 @@
+#include <QDateTime>
+#include "reconnect_backoff.h"
+
+ReconnectBackoff::ReconnectBackoff(int initialDelayMs, int maxDelayMs):
+    mInitialDelay(qMax(1, initialDelayMs)),
+    mMaxDelay(qMax(initialDelayMs, maxDelayMs)),
+    mAttempts(0)
+{
+    // Every instance gets its own sequence, also when created at the same time
+    mSeed = static_cast<quint32>(QDateTime::currentMSecsSinceEpoch()) ^
+            static_cast<quint32>(reinterpret_cast<quintptr>(this));
+    if (mSeed == 0)
+        mSeed = 1;
+}
+
+int ReconnectBackoff::nextDelay()
+{
+    int delay = mInitialDelay;
+    for (int i = 0; i < mAttempts && delay < mMaxDelay; ++i)
+        delay *= 2;
+    delay = qMin(delay, mMaxDelay);
+    ++mAttempts;
+    int half = delay / 2;
+    return delay - half + static_cast<int>(random() % static_cast<quint32>(half + 1));
+}
+
+int ReconnectBackoff::attempts() const
+{
+    return mAttempts;
+}
+
+void ReconnectBackoff::reset()
+{
+    mAttempts = 0;
+}
+
+quint32 ReconnectBackoff::random()
+{
+    // xorshift32, not shared between threads like qrand()
+    mSeed ^= mSeed << 13;
+    mSeed ^= mSeed >> 17;
+    mSeed ^= mSeed << 5;
+    return mSeed;
+}
@@ -0,0 +1,43 @@
+#ifndef RECONNECT_BACKOFF_H
+#define RECONNECT_BACKOFF_H
+
+#include <QtGlobal>
+
+/*!
+ * \brief Chooses the delay before the next attempt to reconnect to a device.
+ * The delay doubles after each failed attempt, from `initialDelay` up to
+ * `maxDelay`. Half of each delay is random ("equal jitter"), so controllers
+ * that lost their connection at the same time (for example when a switch
+ * reboots) do not all reconnect at the same moment.
+ */
+class ReconnectBackoff
+{
+public:
+    ReconnectBackoff(int initialDelayMs, int maxDelayMs);
+
+    /*!
+     * \brief Returns the delay before the next attempt in ms, and counts the
+     * attempt.
+     */
+    int nextDelay();
+
+    /*!
+     * \brief Number of attempts since the last `reset`.
+     */
+    int attempts() const;
+
+    /*!
+     * \brief Call after a successful connection.
+     */
+    void reset();
+
+private:
+    quint32 random();
+
+    int mInitialDelay;
+    int mMaxDelay;
+    int mAttempts;
+    quint32 mSeed;
+};
+
+#endif // RECONNECT_BACKOFF_H
@@ -0,0 +1,123 @@
+#include <algorithm>
+#include <QtGlobal>
+#include "register_planner.h"
+
+// A round trip on a local network with the controller's Modbus stack is in
+// the order of 10 ms, one register takes 2 bytes on a (slow) 10 Mbit link
+// through the controller's serial bridge: about 100 us. Gaps of less than
+// 100 registers are therefore read rather than skipped.
+const double DEFAULT_TRANSACTION_COST   = 10000;
+const double DEFAULT_REGISTER_COST      = 100;
+
+static bool blockBefore(const RegisterPlanner::Block &a, const RegisterPlanner::Block &b)
+{
+    return a.first < b.first;
+}
+
+RegisterPlanner::RegisterPlanner():
+    mTransactionCost(DEFAULT_TRANSACTION_COST),
+    mRegisterCost(DEFAULT_REGISTER_COST),
+    mSpanCount(0)
+{
+}
+
+void RegisterPlanner::setCostModel(double transactionCost, double registerCost)
+{
+    mTransactionCost = qMax(0.0, transactionCost);
+    mRegisterCost = qMax(0.0, registerCost);
+}
+
+double RegisterPlanner::transactionCost() const
+{
+    return mTransactionCost;
+}
+
+double RegisterPlanner::registerCost() const
+{
+    return mRegisterCost;
+}
+
+void RegisterPlanner::clear()
+{
+    mSpans.clear();
+    mSpanCount = 0;
+}
+
+void RegisterPlanner::addSpan(int first, int count)
+{
+    if (count <= 0)
+        return;
+    ++mSpanCount;
+    // Spans longer than a single read are split up front
+    while (count > 0) {
+        Block b;
+        b.first = first;
+        b.count = qMin(count, (int)MaxRegisters);
+        mSpans.append(b);
+        first += b.count;
+        count -= b.count;
+    }
+}
+
+int RegisterPlanner::spanCount() const
+{
+    return mSpanCount;
+}
+
+void RegisterPlanner::plan(QVector<Block> &blocks)
+{
+    blocks.clear();
+    if (mSpans.isEmpty())
+        return;
+
+    // Sort and merge overlapping spans, as long as they fit in one read.
+    std::sort(mSpans.begin(), mSpans.end(), blockBefore);
+    int n = 0;
+    for (int i = 1; i < mSpans.size(); ++i) {
+        Block &last = mSpans[n];
+        const Block &s = mSpans[i];
+        int end = qMax(last.first + last.count, s.first + s.count);
+        if (s.first <= last.first + last.count && end - last.first <= MaxRegisters)
+            last.count = end - last.first;
+        else
+            mSpans[++n] = s;
+    }
+    mSpans.resize(n + 1);
+    n = mSpans.size();
+
+    // mCost[j]: lowest cost of reading spans 0..j-1, where the last read
+    // starts at span mFrom[j].
+    mCost.fill(0, n + 1);
+    mFrom.fill(0, n + 1);
+    for (int j = 1; j <= n; ++j) {
+        int end = mSpans[j - 1].first + mSpans[j - 1].count;
+        mCost[j] = -1;
+        for (int i = j - 1; i >= 0; --i) {
+            int count = end - mSpans[i].first;
+            if (count > MaxRegisters)
+                break;
+            double cost = mCost[i] + mTransactionCost + count * mRegisterCost;
+            if (mCost[j] < 0 || cost < mCost[j]) {
+                mCost[j] = cost;
+                mFrom[j] = i;
+            }
+        }
+    }
+
+    for (int j = n; j > 0; j = mFrom[j]) {
+        Block b;
+        b.first = mSpans[mFrom[j]].first;
+        b.count = mSpans[j - 1].first + mSpans[j - 1].count - b.first;
+        blocks.append(b);
+    }
+    std::reverse(blocks.begin(), blocks.end());
+}
+
+int RegisterPlanner::findBlock(const QVector<Block> &blocks, int address)
+{
+    for (int i = 0; i < blocks.size(); ++i) {
+        if (address >= blocks[i].first && address < blocks[i].first + blocks[i].count)
+            return i;
+    }
+    return -1;
+}
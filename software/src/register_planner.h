@@ -0,0 +1,73 @@
+#ifndef REGISTER_PLANNER_H
+#define REGISTER_PLANNER_H
+
+#include <QVector>
+
+/*!
+ * \brief Plans the Modbus reads for a set of wanted register spans.
+ * Reading a gap between two spans costs bytes on the wire, a separate read
+ * costs a round trip. The planner chooses the set of block reads with the
+ * lowest total cost:
+ *     reads * transactionCost + registers read * registerCost
+ * where each read covers at most `MaxRegisters` consecutive registers. Spans
+ * are sorted and overlapping spans are merged first, the blocks are then found
+ * by dynamic programming over the sorted spans. The costs are in arbitrary,
+ * but equal, units; for example the round trip time and the time to transfer
+ * one register (2 bytes) in microseconds.
+ */
+class RegisterPlanner
+{
+public:
+    struct Block
+    {
+        int first;
+        int count;
+    };
+
+    /*!
+     * \brief Maximum number of registers of a Read Input Registers request.
+     */
+    static const int MaxRegisters = 125;
+
+    RegisterPlanner();
+
+    void setCostModel(double transactionCost, double registerCost);
+    double transactionCost() const;
+    double registerCost() const;
+
+    /*!
+     * \brief Removes all wanted spans.
+     */
+    void clear();
+
+    /*!
+     * \brief Adds `count` registers starting at `first` to the wanted set.
+     */
+    void addSpan(int first, int count);
+
+    /*!
+     * \brief Number of spans added since the last `clear`, which is the
+     * number of reads needed without planning.
+     */
+    int spanCount() const;
+
+    /*!
+     * \brief Stores the planned reads, ordered by address, in `blocks`.
+     */
+    void plan(QVector<Block> &blocks);
+
+    /*!
+     * \brief Returns the block in `blocks` containing `address`, or -1.
+     */
+    static int findBlock(const QVector<Block> &blocks, int address);
+
+private:
+    double mTransactionCost;
+    double mRegisterCost;
+    int mSpanCount;
+    QVector<Block> mSpans;
+    QVector<double> mCost;
+    QVector<int> mFrom;
+};
+
+#endif // REGISTER_PLANNER_H
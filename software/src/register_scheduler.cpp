@@ -0,0 +1,81 @@
+#include "register_scheduler.h"
+
+RegisterScheduler::RegisterScheduler()
+{
+}
+
+int RegisterScheduler::addGroup(int firstRegister, int count, int periodMs)
+{
+    Q_ASSERT(periodMs > 0);
+    Group g;
+    g.firstRegister = firstRegister;
+    g.count = count;
+    g.periodMs = periodMs;
+    g.deadline = 0;
+    mGroups.append(g);
+    return mGroups.size() - 1;
+}
+
+int RegisterScheduler::groupCount() const
+{
+    return mGroups.size();
+}
+
+int RegisterScheduler::firstRegister(int group) const
+{
+    return mGroups[group].firstRegister;
+}
+
+int RegisterScheduler::registerCount(int group) const
+{
+    return mGroups[group].count;
+}
+
+int RegisterScheduler::period(int group) const
+{
+    return mGroups[group].periodMs;
+}
+
+void RegisterScheduler::setPeriod(int group, int periodMs, qint64 nowMs)
+{
+    Q_ASSERT(periodMs > 0);
+    Group &g = mGroups[group];
+    if (g.periodMs == periodMs)
+        return;
+    g.periodMs = periodMs;
+    if (g.deadline > nowMs + periodMs)
+        g.deadline = nowMs + periodMs;
+}
+
+void RegisterScheduler::reset(qint64 nowMs)
+{
+    for (int i = 0; i < mGroups.size(); ++i)
+        mGroups[i].deadline = nowMs;
+}
+
+void RegisterScheduler::takeDue(qint64 nowMs, QVector<int> &groups)
+{
+    groups.resize(0);
+    for (int i = 0; i < mGroups.size(); ++i) {
+        Group &g = mGroups[i];
+        if (g.deadline > nowMs)
+            continue;
+        groups.append(i);
+        g.deadline += g.periodMs;
+        if (g.deadline <= nowMs) {
+            // Skip the slots we missed, but stay on the original grid.
+            qint64 missed = (nowMs - g.deadline) / g.periodMs + 1;
+            g.deadline += missed * g.periodMs;
+        }
+    }
+}
+
+qint64 RegisterScheduler::nextDeadline() const
+{
+    qint64 result = -1;
+    for (int i = 0; i < mGroups.size(); ++i) {
+        if (result == -1 || mGroups[i].deadline < result)
+            result = mGroups[i].deadline;
+    }
+    return result;
+}
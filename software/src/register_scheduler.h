@@ -0,0 +1,67 @@
+#ifndef REGISTER_SCHEDULER_H
+#define REGISTER_SCHEDULER_H
+
+#include <QtGlobal>
+#include <QVector>
+
+/*!
+ * \brief Fixed-rate schedule for groups of Modbus registers.
+ * Each group is a span of registers with its own polling period. Deadlines
+ * advance by whole periods from the previous deadline (not from the time the
+ * read completed), so the schedule does not drift when reads are slow. If a
+ * deadline is missed by more than one period, the missed slots are skipped
+ * instead of being caught up in a burst.
+ * All times are in ms from an arbitrary monotonic origin.
+ */
+class RegisterScheduler
+{
+public:
+    RegisterScheduler();
+
+    /*!
+     * \brief Adds a group of `count` registers starting at `firstRegister`.
+     * \return The index of the new group.
+     */
+    int addGroup(int firstRegister, int count, int periodMs);
+
+    int groupCount() const;
+    int firstRegister(int group) const;
+    int registerCount(int group) const;
+    int period(int group) const;
+
+    /*!
+     * \brief Changes the period of a group. The next deadline is moved so it
+     * is at most one new period away.
+     */
+    void setPeriod(int group, int periodMs, qint64 nowMs);
+
+    /*!
+     * \brief Makes all groups due at `nowMs`.
+     */
+    void reset(qint64 nowMs);
+
+    /*!
+     * \brief Stores the groups which are due at `nowMs` in `groups` (ordered
+     * by group index) and advances their deadlines to the next slot.
+     */
+    void takeDue(qint64 nowMs, QVector<int> &groups);
+
+    /*!
+     * \brief Returns the earliest deadline of all groups, or -1 if there are
+     * no groups.
+     */
+    qint64 nextDeadline() const;
+
+private:
+    struct Group
+    {
+        int firstRegister;
+        int count;
+        int periodMs;
+        qint64 deadline;
+    };
+
+    QVector<Group> mGroups;
+};
+
+#endif // REGISTER_SCHEDULER_H
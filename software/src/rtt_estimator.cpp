@@ -0,0 +1,73 @@
+#include <QtGlobal>
+#include "rtt_estimator.h"
+
+// Gains of RFC 6298: alpha = 1/8, beta = 1/4, K = 4
+const double SRTT_GAIN      = 0.125;
+const double RTTVAR_GAIN    = 0.25;
+const int RTTVAR_FACTOR     = 4;
+// Enough doublings to reach any ceiling from the minimum
+const int MAX_BACKOFF_SHIFT = 8;
+
+RttEstimator::RttEstimator(int minTimeoutMs, int maxTimeoutMs):
+    mMinTimeout(qMax(1, minTimeoutMs)),
+    mMaxTimeout(qMax(mMinTimeout, maxTimeoutMs)),
+    mHasSamples(false),
+    mSrtt(0),
+    mRttVar(0),
+    mBackoffShift(0)
+{
+}
+
+void RttEstimator::setMaxTimeout(int ms)
+{
+    mMaxTimeout = qMax(mMinTimeout, ms);
+}
+
+int RttEstimator::maxTimeout() const
+{
+    return mMaxTimeout;
+}
+
+void RttEstimator::addSample(int ms)
+{
+    double r = qMax(0, ms);
+    if (mHasSamples) {
+        mRttVar += RTTVAR_GAIN * (qAbs(mSrtt - r) - mRttVar);
+        mSrtt += SRTT_GAIN * (r - mSrtt);
+    } else {
+        mSrtt = r;
+        mRttVar = r / 2;
+        mHasSamples = true;
+    }
+    mBackoffShift = 0;
+}
+
+void RttEstimator::backOff()
+{
+    if (mBackoffShift < MAX_BACKOFF_SHIFT)
+        ++mBackoffShift;
+}
+
+int RttEstimator::timeout() const
+{
+    if (!mHasSamples)
+        return mMaxTimeout;
+    double t = mSrtt + qMax(1.0, RTTVAR_FACTOR * mRttVar);
+    t *= 1 << mBackoffShift;
+    return (int)qBound((double)mMinTimeout, t, (double)mMaxTimeout);
+}
+
+bool RttEstimator::hasSamples() const
+{
+    return mHasSamples;
+}
+
+double RttEstimator::srtt() const
+{
+    return mSrtt;
+}
+
+double RttEstimator::rttvar() const
+{
+    return mRttVar;
+}
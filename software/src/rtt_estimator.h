@@ -0,0 +1,50 @@
+#ifndef RTT_ESTIMATOR_H
+#define RTT_ESTIMATOR_H
+
+/*!
+ * \brief Response timeout derived from the measured round trip times.
+ * Keeps a smoothed round trip time (SRTT) and its mean deviation (RTTVAR) as
+ * TCP does (RFC 6298), and returns SRTT + 4 * RTTVAR as the timeout, limited to
+ * [`minTimeout`, `maxTimeout`]. Each `backOff` doubles the timeout, the next
+ * sample restores it. Until the first sample the timeout is `maxTimeout`.
+ */
+class RttEstimator
+{
+public:
+    RttEstimator(int minTimeoutMs, int maxTimeoutMs);
+
+    /*!
+     * \brief Sets the ceiling of the timeout, in ms.
+     */
+    void setMaxTimeout(int ms);
+    int maxTimeout() const;
+
+    /*!
+     * \brief Adds the round trip time of a completed request.
+     */
+    void addSample(int ms);
+
+    /*!
+     * \brief Doubles the timeout, call after a request has timed out.
+     */
+    void backOff();
+
+    /*!
+     * \brief The timeout of the next request, in ms.
+     */
+    int timeout() const;
+
+    bool hasSamples() const;
+    double srtt() const;
+    double rttvar() const;
+
+private:
+    int mMinTimeout;
+    int mMaxTimeout;
+    bool mHasSamples;
+    double mSrtt;
+    double mRttVar;
+    int mBackoffShift;
+};
+
+#endif // RTT_ESTIMATOR_H
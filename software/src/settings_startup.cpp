@@ -0,0 +1,118 @@
+#include <QDBusMessage>
+#include <QDBusPendingCallWatcher>
+#include <QDBusPendingReply>
+#include <QDBusServiceWatcher>
+#include <QsLog.h>
+#include <QTimer>
+#include <velib/qt/v_busitems.h>
+#include "dbus_bridge.h"
+#include "process_stats.h"
+#include "settings_startup.h"
+
+static const char *SettingsService = "com.victronenergy.settings";
+
+SettingsStartup::SettingsStartup(QObject *parent):
+    QObject(parent),
+    mWatcher(0),
+    mTimeout(new QTimer(this)),
+    mSettingsFound(false),
+    mReady(false),
+    mPendingCalls(0)
+{
+    mTimeout->setSingleShot(true);
+    connect(mTimeout, SIGNAL(timeout()), this, SLOT(onTimeout()));
+}
+
+void SettingsStartup::addSetting(const QString &path, const QVariant &defaultValue,
+                                 const QVariant &minValue, const QVariant &maxValue)
+{
+    Setting s;
+    s.path = path;
+    s.defaultValue = defaultValue;
+    s.minValue = minValue;
+    s.maxValue = maxValue;
+    mSettings.append(s);
+}
+
+void SettingsStartup::start(int timeoutMs)
+{
+    QDBusConnection &connection = VBusItems::getConnection();
+    // Watch first, so the service cannot appear between the check and the watch.
+    mWatcher = new QDBusServiceWatcher(SettingsService, connection,
+                                       QDBusServiceWatcher::WatchForRegistration, this);
+    connect(mWatcher, SIGNAL(serviceRegistered(QString)), this, SLOT(onServiceRegistered()));
+    QDBusMessage m = QDBusMessage::createMethodCall("org.freedesktop.DBus",
+                                                    "/org/freedesktop/DBus",
+                                                    "org.freedesktop.DBus",
+                                                    "NameHasOwner")
+                     << QString(SettingsService);
+    QDBusPendingCallWatcher *call = new QDBusPendingCallWatcher(connection.asyncCall(m), this);
+    connect(call, SIGNAL(finished(QDBusPendingCallWatcher*)),
+            this, SLOT(onNameHasOwnerFinished(QDBusPendingCallWatcher*)));
+    mTimeout->start(timeoutMs);
+    QLOG_INFO() << "Wait for local settings on DBus...";
+}
+
+bool SettingsStartup::isReady() const
+{
+    return mReady;
+}
+
+void SettingsStartup::onNameHasOwnerFinished(QDBusPendingCallWatcher *call)
+{
+    QDBusPendingReply<bool> reply = *call;
+    call->deleteLater();
+    if (reply.isError())
+        QLOG_WARN() << "NameHasOwner failed:" << reply.error().message();
+    else if (reply.value())
+        onServiceRegistered();
+}
+
+void SettingsStartup::onServiceRegistered()
+{
+    if (mSettingsFound)
+        return;
+    mSettingsFound = true;
+    mTimeout->stop();
+    QLOG_INFO() << "Local settings found," << processAgeMs() << "ms after start";
+
+    QDBusConnection &connection = VBusItems::getConnection();
+    foreach (const Setting &s, mSettings) {
+        QDBusMessage m;
+        if (!DBusBridge::createAddSettingCall(s.path, s.defaultValue, s.minValue,
+                                              s.maxValue, m)) {
+            QLOG_ERROR() << "Invalid setting" << s.path;
+            continue;
+        }
+        QDBusPendingCallWatcher *call = new QDBusPendingCallWatcher(connection.asyncCall(m), this);
+        call->setProperty("path", s.path);
+        connect(call, SIGNAL(finished(QDBusPendingCallWatcher*)),
+                this, SLOT(onAddSettingFinished(QDBusPendingCallWatcher*)));
+        ++mPendingCalls;
+    }
+    if (mPendingCalls == 0) {
+        mReady = true;
+        emit ready();
+    }
+}
+
+void SettingsStartup::onAddSettingFinished(QDBusPendingCallWatcher *call)
+{
+    if (call->isError())
+        QLOG_ERROR() << "AddSetting" << call->property("path").toString() << "failed:"
+                     << call->error().message();
+    call->deleteLater();
+    if (--mPendingCalls > 0)
+        return;
+    QLOG_INFO() << "Settings created," << processAgeMs() << "ms after start";
+    mReady = true;
+    emit ready();
+}
+
+void SettingsStartup::onTimeout()
+{
+    if (mSettingsFound)
+        return;
+    QLOG_ERROR() << "Local settings not found";
+    emit failed();
+}
@@ -0,0 +1,72 @@
+#ifndef SETTINGS_STARTUP_H
+#define SETTINGS_STARTUP_H
+
+#include <QList>
+#include <QObject>
+#include <QString>
+#include <QVariant>
+
+class QDBusPendingCallWatcher;
+class QDBusServiceWatcher;
+class QTimer;
+
+/*!
+ * \brief Waits for localsettings and creates our settings.
+ * Instead of polling, the owner of com.victronenergy.settings is watched
+ * (NameOwnerChanged) and asked for once (NameHasOwner), so startup continues
+ * as soon as the service appears. All AddSetting calls are then sent at once
+ * without waiting for each reply, and `ready` is emitted when all of them
+ * have been answered.
+ */
+class SettingsStartup : public QObject
+{
+    Q_OBJECT
+public:
+    explicit SettingsStartup(QObject *parent = 0);
+
+    /*!
+     * \brief Queues an AddSetting call, sent once localsettings is available.
+     * Must be called before `start`.
+     */
+    void addSetting(const QString &path, const QVariant &defaultValue,
+                    const QVariant &minValue, const QVariant &maxValue);
+
+    /*!
+     * \brief Starts waiting. `failed` is emitted if localsettings does not
+     * appear within `timeoutMs`.
+     */
+    void start(int timeoutMs);
+
+    /*!
+     * \brief True once all AddSetting calls have been answered.
+     */
+    bool isReady() const;
+
+signals:
+    void ready();
+    void failed();
+
+private slots:
+    void onServiceRegistered();
+    void onNameHasOwnerFinished(QDBusPendingCallWatcher *call);
+    void onAddSettingFinished(QDBusPendingCallWatcher *call);
+    void onTimeout();
+
+private:
+    struct Setting
+    {
+        QString path;
+        QVariant defaultValue;
+        QVariant minValue;
+        QVariant maxValue;
+    };
+
+    QList<Setting> mSettings;
+    QDBusServiceWatcher *mWatcher;
+    QTimer *mTimeout;
+    bool mSettingsFound;
+    bool mReady;
+    int mPendingCalls;
+};
+
+#endif // SETTINGS_STARTUP_H
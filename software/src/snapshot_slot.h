@@ -0,0 +1,81 @@
+#ifndef SNAPSHOT_SLOT_H
+#define SNAPSHOT_SLOT_H
+
+#include <atomic>
+
+/*!
+ * \brief Lock-free single producer/single consumer handoff of the latest value.
+ * A triple buffer: the producer fills `writeBuffer()` and calls `publish()`,
+ * the consumer calls `update()` and reads `readBuffer()`. Neither side ever
+ * blocks or waits for the other, and the consumer always gets the most recent
+ * published value. Intermediate values are dropped if the consumer is slower
+ * than the producer.
+ * The producer and the consumer may live in different threads, but each side
+ * must only be used from a single thread.
+ */
+template<class T>
+class SnapshotSlot
+{
+public:
+    SnapshotSlot():
+        mMiddle(1),
+        mWrite(0),
+        mRead(2)
+    {
+    }
+
+    /*!
+     * \brief Buffer to be filled by the producer before calling `publish`.
+     * Its contents are undefined after `publish`: it may hold an older value.
+     */
+    T &writeBuffer()
+    {
+        return mBuffers[mWrite];
+    }
+
+    /*!
+     * \brief Makes the contents of `writeBuffer()` available to the consumer.
+     */
+    void publish()
+    {
+        int previous = mMiddle.exchange(mWrite | Dirty, std::memory_order_acq_rel);
+        mWrite = previous & IndexMask;
+    }
+
+    /*!
+     * \brief Fetches the latest published value.
+     * \retval false if nothing was published since the last call.
+     */
+    bool update()
+    {
+        if ((mMiddle.load(std::memory_order_relaxed) & Dirty) == 0)
+            return false;
+        int previous = mMiddle.exchange(mRead, std::memory_order_acq_rel);
+        mRead = previous & IndexMask;
+        return true;
+    }
+
+    /*!
+     * \brief The value obtained by the last successful `update`.
+     */
+    const T &readBuffer() const
+    {
+        return mBuffers[mRead];
+    }
+
+private:
+    enum {
+        IndexMask = 0x3,
+        Dirty = 0x4
+    };
+
+    SnapshotSlot(const SnapshotSlot &);
+    SnapshotSlot &operator=(const SnapshotSlot &);
+
+    T mBuffers[3];
+    std::atomic<int> mMiddle;
+    int mWrite;     // Only used by the producer
+    int mRead;      // Only used by the consumer
+};
+
+#endif // SNAPSHOT_SLOT_H
@@ -1,272 +1,114 @@
-#include <errno.h>
 #include <QsLog.h>
-#include <qtimer.h>
+#include <QThread>
+#include "tsmppt_acquisition.h"
 #include "tsmppt.h"
 
-const int REG_V_PU          = 0;
-const int REG_I_PU          = 2;
-const int REG_VER_SW        = 4;
-const int REG_FIRST_DYN     = 24;
-const int REG_V_BAT         = 24;
-const int REG_V_PV          = 27;
-const int REG_I_PV          = 29;
-const int REG_I_CC          = 28;
-const int REG_T_BAT         = 37;
-const int REG_I_CC_1M       = 39;
-const int REG_CHARGE_STATE  = 50;
-const int REG_KWH_TOTAL_RES = 56;
-const int REG_KWH_TOTAL     = 57;
-const int REG_POUT          = 58;
-const int REG_V_BAT_MIN     = 64;
-const int REG_V_BAT_MAX     = 65;
-const int REG_V_PV_MAX      = 66;
-const int REG_WHC_DAILY     = 68;
-const int REG_POUT_MAX_DAILY= 70;
-const int REG_T_FLOAT       = 79;
-const int REG_T_ABS         = 77;
-const int REG_LAST_DYN      = 79;
-const int REG_EHW_VERSION   = 57549;
-const int REG_ESERIAL       = 57536;
-const int REG_EMODEL        = 57548;
-
-const int CS_NIGHT          = 3;
-const int CS_BULK           = 5;
-
+static_assert(Tsmppt::ValueCount <= 32, "Change set of valuesUpdated does not fit in 32 bits");
 
 Tsmppt::Tsmppt(const QString &IPAddress, const int port, int interval, int slave, QObject *parent):
-QObject(parent), mInitialized(false), mTimer(new QTimer(this)), m_interval(interval), m_cs(0), m_t_bulk(1),
-m_t_bulk_ms(0), yield_user(0), yield_system(0)
+QObject(parent), mAcquisition(new TsmpptAcquisition(IPAddress, port, interval, slave)),
+mChangeSet(0), mBatchDepth(0), mConnected(false), m_t_bulk(1), yield_user(0), yield_system(0), m_fw_ver(0)
 {
+    for (int i = 0; i < RegisterCount; ++i)
+        m_values[i] = 0;
     QLOG_DEBUG() << "Tsmppt::Tsmppt(" << IPAddress << ", " << port << ", " << interval << ", " << slave << ")";
-    mCtx = modbus_new_tcp_pi(IPAddress.toStdString().c_str(), QString::number(port).toStdString().c_str());
-    Q_ASSERT(mCtx != NULL);
-    // modbus_set_debug(mCtx, true);
-    modbus_set_error_recovery(mCtx, MODBUS_ERROR_RECOVERY_LINK);
-#if LIBMODBUS_VERSION_CHECK(3, 1, 1)
-    modbus_set_response_timeout(mCtx, 20, 0);
-    modbus_set_byte_timeout(mCtx, 10, 0);
-#else
-    struct timeval to;
-    to.tv_sec = 20;
-    to.tv_usec = 0;
-    modbus_set_response_timeout(mCtx, &to);
-    to.tv_sec = 10;
-    modbus_set_byte_timeout(mCtx, &to);
-#endif
-    modbus_set_slave(mCtx, slave);
-    mTimer->setInterval(m_interval);
-    connect(mTimer, SIGNAL(timeout()), this, SLOT(onTimeout()));
+    // Signals from the acquisition thread are queued, so they are delivered
+    // in order and dropped if this object is deleted first.
+    connect(mAcquisition, SIGNAL(snapshotReady()), this, SLOT(onSnapshotReady()));
+    connect(mAcquisition, SIGNAL(tsmpptConnected()), this, SLOT(onConnected()));
+    connect(mAcquisition, SIGNAL(connectionLost()), this, SLOT(onConnectionLost()));
+    mAcquisition->moveToThread(TsmpptAcquisition::acquisitionThread());
 }
 
 Tsmppt::~Tsmppt()
 {
     QLOG_DEBUG() << "Tsmppt::~Tsmppt()";
-    modbus_free(mCtx);
-}
-
-bool Tsmppt::readInputRegisters(int addr, int nb, uint16_t *dest)
-{
-    int tries = 5;
-    while (tries > 0)
-    {
-        if(modbus_read_input_registers(mCtx, addr, nb, dest) != -1)
-        {
-            return true;
-        }
-        if (tries > 1)
-        {
-            QLOG_ERROR() << "MODBUS:" << modbus_strerror(errno) << "Retrying (" << 5-tries+1 << ")...";
-        }
-        tries--;
-    }
-    modbus_close(mCtx);
-    QLOG_ERROR() << "MODBUS:" << modbus_strerror(errno) << "Trying to reconnect";
-    emit connectionLost();
-    return false;
-}
-
-bool Tsmppt::initialize()
-{
-    Q_ASSERT(mCtx != NULL);
-
-    QLOG_DEBUG() << "Tsmppt::initialize(start)";
-
-    if (modbus_connect(mCtx) == -1)
-    {
-        QLOG_ERROR() << "MODBUS:" << modbus_strerror(errno);
-        return false;
-    }
-
-    uint16_t regs[6];
-
-    if (!readInputRegisters(REG_V_PU, 6, regs))
-    {
-        modbus_close(mCtx);
-        return false;
-    }
-    
-    // Voltage scaling:
-    m_v_pu = (float)regs[1];
-    m_v_pu /= 65536.0;
-    m_v_pu += (float)regs[0];
-
-    // Current scaling:
-    m_i_pu = (float)regs[3];
-    m_i_pu /= 65536.0;
-    m_i_pu += (float)regs[2];
-    QLOG_DEBUG() << "Tsmppt: m_v_pu =" << m_v_pu << " m_i_pu =" << m_i_pu;
-
-    // Firmware version:
-    uint16_t ver = ((regs[4] >> 12) & 0x0f) * 1000;
-    ver += ((regs[4] >> 8) & 0x0f) * 100;
-    ver += ((regs[4] >> 4) & 0x0f) * 10;
-    ver += regs[4] & 0x0f;
-    setFirmwareVersion(ver);
-
-    // Hardware version:
-    if (!readInputRegisters(REG_EHW_VERSION, 1, regs))
-    {
-        modbus_close(mCtx);
-        return false;
-    }
-    setHardwareVersion(QString::number(regs[0] >> 8) + "." + QString::number(regs[0] & 0xff));
-
-    // Model
-    if (!readInputRegisters(REG_EMODEL, 1, regs))
-    {
-        modbus_close(mCtx);
-        return false;
-    }
-    QString name;
-    switch (regs[0])
-    {
-        case 0:
-            name = "TriStar MPPT 45";
-            break;
-
-        case 1:
-            name = "TriStar MPPT 60";
-            break;
-
-        case 2:
-            name = "TriStar MPPT 30";
-            break;
-
-        default:
-            name = "";
-    }
-    setProductName(name);
-
-    // Serial number:
-    if (!readInputRegisters(REG_ESERIAL, 4, regs))
-    {
-        modbus_close(mCtx);
-        return false;
-    }
-    uint64_t serial = (uint64_t)((regs[0] & 0xff) - 0x30) * 10000000;
-    serial += (uint64_t)((regs[0] >> 8) - 0x30) * 1000000;
-    serial += (uint64_t)((regs[1] & 0xff) - 0x30) * 100000;
-    serial += (uint64_t)((regs[1] >> 8) - 0x30) * 10000;
-    serial += (uint64_t)((regs[2] & 0xff) - 0x30) * 1000;
-    serial += (uint64_t)((regs[2] >> 8) - 0x30) * 100;
-    serial += (uint64_t)((regs[3] & 0xff) - 0x30) * 10;
-    serial += (uint64_t)((regs[3] >> 8) - 0x30);
-    setSerialNumber(QString::number(serial));
-
-
-    modbus_close(mCtx);
-    mInitialized = true;
+    // After stop() returns the acquisition object will not touch the snapshot
+    // slot again, and it is deleted in its own thread.
+    if (mAcquisition->thread()->isRunning())
+        QMetaObject::invokeMethod(mAcquisition, "stop", Qt::BlockingQueuedConnection);
+    mAcquisition->deleteLater();
+}
+
+void Tsmppt::setTarget(const QString &IPAddress, int port, int slave)
+{
+    QMetaObject::invokeMethod(mAcquisition, "setTarget", Qt::QueuedConnection,
+                              Q_ARG(QString, IPAddress), Q_ARG(int, port), Q_ARG(int, slave));
+}
+
+void Tsmppt::setInterval(int interval)
+{
+    QMetaObject::invokeMethod(mAcquisition, "setInterval", Qt::QueuedConnection,
+                              Q_ARG(int, interval));
+}
+
+void Tsmppt::setTimeout(int timeout)
+{
+    QMetaObject::invokeMethod(mAcquisition, "setTimeout", Qt::QueuedConnection,
+                              Q_ARG(int, timeout));
+}
+
+void Tsmppt::onSnapshotReady()
+{
+    SnapshotSlot<TsmpptSnapshot> &slot = mAcquisition->snapshots();
+    if (!slot.update())
+        return;
+    const TsmpptSnapshot &s = slot.readBuffer();
+    // Collect the changes of the whole snapshot into one valuesUpdated signal
+    ++mBatchDepth;
+    setFirmwareVersion(s.firmwareVersion);
+    setHardwareVersion(s.hardwareVersion);
+    setProductName(s.productName);
+    setSerialNumber(s.serialNumber);
+    for (int i = 0; i < RegisterCount; ++i)
+        setRegisterValue(i, s.values[i]);
+    setYieldUser(s.yieldUser);
+    setYieldSystem(s.yieldSystem);
+    setTimeInBulk(s.timeInBulk);
+    --mBatchDepth;
+    markChanged(-1);
+}
+
+void Tsmppt::onConnected()
+{
+    mConnected = true;
+    emit connectedChanged();
     emit tsmpptConnected();
-    QLOG_DEBUG() << "Tsmppt::initialize(end)";
-    QString logmsg = productName() + " (serial #" + serialNumber() + ", controler v" + hardwareVersion() + "." + firmwareVersion() + ") connected";
-    QLOG_INFO() << logmsg.toStdString().c_str();
-    return true;
+    // Republish the values that were invalidated while disconnected, also the
+    // ones that did not change.
+    markAllChanged();
 }
 
-void Tsmppt::updateValues()
+void Tsmppt::onConnectionLost()
 {
-    uint16_t reg[REG_LAST_DYN-REG_FIRST_DYN+1];
+    // The acquisition reconnects by itself, the last values are kept but are
+    // published as invalid by the bridge.
+    mConnected = false;
+    emit connectedChanged();
+    emit connectionLost();
+    markAllChanged();
+}
 
-    QLOG_DEBUG() << "Tsmppt::updateValues()";
+int Tsmppt::connected() const
+{
+    return mConnected ? 1 : 0;
+}
+
+void Tsmppt::markAllChanged()
+{
+    mChangeSet |= ValueCount < 32 ? (1u << ValueCount) - 1 : ~0u;
+    markChanged(-1);
+}
 
-    if (modbus_connect(mCtx) == -1)
-    {
-        QLOG_ERROR() << "MODBUS:" << modbus_strerror(errno);
+void Tsmppt::markChanged(int value)
+{
+    if (value >= 0)
+        mChangeSet |= 1u << value;
+    if (mBatchDepth > 0 || mChangeSet == 0)
         return;
-    }
-
-    if (readInputRegisters(REG_FIRST_DYN, REG_LAST_DYN-REG_FIRST_DYN+1, reg))
-    {
-        // Battery voltage:
-        double temp = (double)reg[REG_V_BAT-REG_FIRST_DYN] * m_v_pu / 32768.0;
-        setBatteryVoltage(temp);
-
-        // Max Battery voltage:
-        temp = (double)reg[REG_V_BAT_MAX-REG_FIRST_DYN] * m_v_pu / 32768.0;
-        setBatteryVoltageMaxDaily(temp);
-
-        // Min Battery voltage:
-        temp = (double)reg[REG_V_BAT_MIN-REG_FIRST_DYN] * m_v_pu / 32768.0;
-        setBatteryVoltageMinDaily(temp);
-
-        // Battery temperature:
-        temp = (double)(int16_t)reg[REG_T_BAT-REG_FIRST_DYN];
-        setBatteryTemperature(temp);
-
-        // Charge current:
-        temp = (double)(int16_t)reg[REG_I_CC_1M-REG_FIRST_DYN] * m_i_pu / 32768.0;
-        if (temp < 0.0)
-            temp = 0.0;
-        setChargingCurrent(temp);
-        
-        // MPPT output power:
-        temp = (double)reg[REG_POUT-REG_FIRST_DYN] * m_i_pu * m_v_pu / 131072.0;
-        setOutputPower(temp);
-
-        // PV array voltage:
-        temp = (double)reg[REG_V_PV-REG_FIRST_DYN]  * m_v_pu / 32768.0;
-        setArrayVoltage(temp);
-
-        // Max PV array voltage:
-        temp = (double)reg[REG_V_PV_MAX-REG_FIRST_DYN]  * m_v_pu / 32768.0;
-        setArrayVoltageMaxDaily(temp);
-
-        // PV array current:
-        temp = (double)reg[REG_I_PV-REG_FIRST_DYN] * m_i_pu / 32768.0;
-        setArrayCurrent(temp);
-
-        // Whc daily:
-        temp = (double)reg[REG_WHC_DAILY-REG_FIRST_DYN];
-        // CCGX expects kWh:
-        temp /= 1000.0;
-        setWattHoursDaily(temp);
-
-        // Whc total:
-        temp = (double)reg[REG_KWH_TOTAL_RES-REG_FIRST_DYN];
-        setWattHoursTotalResettable(temp);
-        setYieldUser(m_whc+temp);
-
-        // Whc total:
-        temp = (double)reg[REG_KWH_TOTAL-REG_FIRST_DYN];
-        setWattHoursTotal(temp);
-        setYieldSystem(m_whc+temp);
-
-        // Pmax daily:
-        temp = (double)reg[REG_POUT_MAX_DAILY-REG_FIRST_DYN] * m_i_pu * m_v_pu / 131072.0;
-        setPowerMaxDaily(temp);
-
-        // Charge state:
-        setChargeState(reg[REG_CHARGE_STATE-REG_FIRST_DYN]);
-
-        if (m_cs == CS_BULK)
-            m_t_bulk_ms += m_interval;
-        else if (m_cs == CS_NIGHT)
-            m_t_bulk_ms = 0;
-        setTimeInBulk((int)(m_t_bulk_ms/(1000*60)));
-        setTimeInAbsorption(reg[REG_T_ABS-REG_FIRST_DYN]/60);
-        setTimeInFloat(reg[REG_T_FLOAT-REG_FIRST_DYN]/60);
-    }
-    modbus_close(mCtx);
+    quint32 changeSet = mChangeSet;
+    mChangeSet = 0;
+    emit valuesUpdated(changeSet);
 }
 
 int Tsmppt::firmwareVersion() const
@@ -280,6 +122,7 @@ void Tsmppt::setFirmwareVersion(int v)
         return;
     m_fw_ver = v;
     emit firmwareVersionChanged();
+    markChanged(FirmwareVersionValue);
 }
 
 QString Tsmppt::hardwareVersion() const
@@ -293,6 +136,7 @@ void Tsmppt::setHardwareVersion(QString v)
         return;
     m_hw_ver = v;
     emit hardwareVersionChanged();
+    markChanged(HardwareVersionValue);
 }
 
 QString Tsmppt::serialNumber() const
@@ -306,175 +150,137 @@ void Tsmppt::setSerialNumber(QString v)
         return;
     m_serial = v;
     emit serialNumberChanged();
+    markChanged(SerialNumberValue);
 }
 
 double Tsmppt::batteryVoltage() const
 {
-    return m_v_bat;
+    return m_values[RegBatteryVoltage];
 }
 
 void Tsmppt::setBatteryVoltage(double v)
 {
-    if (m_v_bat == v)
-        return;
-    m_v_bat = v;
-    emit batteryVoltageChanged();
+    setRegisterValue(RegBatteryVoltage, v);
 }
 
 double Tsmppt::batteryVoltageMaxDaily() const
 {
-    return m_v_bat_max;
+    return m_values[RegBatteryVoltageMaxDaily];
 }
 
 void Tsmppt::setBatteryVoltageMaxDaily(double v)
 {
-    if (m_v_bat_max == v)
-        return;
-    m_v_bat_max = v;
-    emit batteryVoltageMaxDailyChanged();
+    setRegisterValue(RegBatteryVoltageMaxDaily, v);
 }
 
 double Tsmppt::batteryVoltageMinDaily() const
 {
-    return m_v_bat_min;
+    return m_values[RegBatteryVoltageMinDaily];
 }
 
 void Tsmppt::setBatteryVoltageMinDaily(double v)
 {
-    if (m_v_bat_min == v)
-        return;
-    m_v_bat_min = v;
-    emit batteryVoltageMinDailyChanged();
+    setRegisterValue(RegBatteryVoltageMinDaily, v);
 }
 
 double Tsmppt::batteryTemperature() const
 {
-    return m_t_bat;
+    return m_values[RegBatteryTemperature];
 }
 
 void Tsmppt::setBatteryTemperature(double v)
 {
-    if (m_t_bat == v)
-        return;
-    m_t_bat = v;
-    emit batteryTemperatureChanged();
+    setRegisterValue(RegBatteryTemperature, v);
 }
 
 double Tsmppt::chargingCurrent() const
 {
-    return m_i_cc;
+    return m_values[RegChargingCurrent];
 }
 
 double Tsmppt::outputPower() const
 {
-    return m_pout;
+    return m_values[RegOutputPower];
 }
 
 void Tsmppt::setChargingCurrent(double v)
 {
-    if (m_i_cc == v)
-        return;
-    m_i_cc = v;
-    emit chargingCurrentChanged();
+    setRegisterValue(RegChargingCurrent, v);
 }
 
 void Tsmppt::setOutputPower(double v)
 {
-    if (m_pout == v)
-        return;
-    m_pout = v;
-    emit outputPowerChanged();
+    setRegisterValue(RegOutputPower, v);
 }
 
 double Tsmppt::arrayCurrent() const
 {
-    return m_i_pv;
+    return m_values[RegArrayCurrent];
 }
 
 void Tsmppt::setArrayCurrent(double v)
 {
-    if (m_i_pv == v)
-        return;
-    m_i_pv = v;
-    emit arrayCurrentChanged();
+    setRegisterValue(RegArrayCurrent, v);
 }
 
 double Tsmppt::arrayVoltage() const
 {
-    return m_v_pv;
+    return m_values[RegArrayVoltage];
 }
 
 void Tsmppt::setArrayVoltage(double v)
 {
-    if (m_v_pv == v)
-        return;
-    m_v_pv = v;
-    emit arrayVoltageChanged();
+    setRegisterValue(RegArrayVoltage, v);
 }
 
 double Tsmppt::arrayVoltageMaxDaily() const
 {
-    return m_v_pv_max;
+    return m_values[RegArrayVoltageMaxDaily];
 }
 
 void Tsmppt::setArrayVoltageMaxDaily(double v)
 {
-    if (m_v_pv_max == v)
-        return;
-    m_v_pv_max = v;
-    emit arrayVoltageMaxDailyChanged();
+    setRegisterValue(RegArrayVoltageMaxDaily, v);
 }
 
 double Tsmppt::powerMaxDaily() const
 {
-    return m_p_max;
+    return m_values[RegPowerMaxDaily];
 }
 
 void Tsmppt::setPowerMaxDaily(double v)
 {
-    if (m_p_max == v)
-        return;
-    m_p_max = v;
-    emit powerMaxDailyChanged();
+    setRegisterValue(RegPowerMaxDaily, v);
 }
 
 double Tsmppt::wattHoursDaily() const
 {
-    return m_whc;
+    return m_values[RegWattHoursDaily];
 }
 
 void Tsmppt::setWattHoursDaily(double v)
 {
-    if (m_whc == v)
-        return;
-    m_whc = v;
-    emit wattHoursDailyChanged();
+    setRegisterValue(RegWattHoursDaily, v);
 }
 
 double Tsmppt::wattHoursTotal() const
 {
-    return m_whc_tot;
+    return m_values[RegWattHoursTotal];
 }
 
 void Tsmppt::setWattHoursTotal(double v)
 {
-    if (m_whc_tot == v)
-        return;
-    m_whc_tot = v;
-    emit wattHoursTotalChanged();
+    setRegisterValue(RegWattHoursTotal, v);
 }
 
 double Tsmppt::wattHoursTotalResettable() const
 {
-    return m_whc_tot_res;
+    return m_values[RegWattHoursTotalResettable];
 }
 
 void Tsmppt::setWattHoursTotalResettable(double v)
 {
-    if (m_whc_tot_res == v)
-        return;
-    m_whc_tot_res = v;
-    emit wattHoursTotalResettableChanged();
+    setRegisterValue(RegWattHoursTotalResettable, v);
 }
 
 int Tsmppt::chargeState() const
@@ -492,33 +298,30 @@ int Tsmppt::chargeState() const
     // 8 EQUALIZE           7 EQUALIZE
     // 9 SLAVE              11 OTHER
     const int bscs[10] = {0,0,0,0,2,3,4,5,7,11};
-    return bscs[m_cs];
+    int cs = (int)m_values[RegChargeState];
+    if (cs < 0 || cs > 9)
+        return 0;
+    return bscs[cs];
 }
 
 void Tsmppt::setChargeState(int v)
 {
-    if (m_cs == v)
-        return;
-    m_cs = v;
-    emit chargeStateChanged();
+    setRegisterValue(RegChargeState, v);
 }
 
 int Tsmppt::timeInAbsorption() const
 {
-    return m_t_abs;
+    return (int)m_values[RegTimeInAbsorption];
 }
 
 void Tsmppt::setTimeInAbsorption(int v)
 {
-    if (m_t_abs == v)
-        return;
-    m_t_abs = v;
-    emit timeInAbsorptionChanged();
+    setRegisterValue(RegTimeInAbsorption, v);
 }
 
 int Tsmppt::timeInFloat() const
 {
-    return m_t_float;
+    return (int)m_values[RegTimeInFloat];
 }
 
 
@@ -528,6 +331,7 @@ void Tsmppt::setTimeInBulk(int v)
         return;
     m_t_bulk = v;
     emit timeInBulkChanged();
+    markChanged(TimeInBulkValue);
 }
 
 int Tsmppt::timeInBulk() const
@@ -541,6 +345,7 @@ void Tsmppt::setYieldUser(double v)
         return;
     yield_user = v;
     emit yieldUserChanged();
+    markChanged(YieldUserValue);
 }
 
 double Tsmppt::yieldUser() const
@@ -554,6 +359,7 @@ void Tsmppt::setYieldSystem(double v)
         return;
     yield_system = v;
     emit yieldSystemChanged();
+    markChanged(YieldSystemValue);
 }
 
 double Tsmppt::yieldSystem() const
@@ -563,10 +369,7 @@ double Tsmppt::yieldSystem() const
 
 void Tsmppt::setTimeInFloat(int v)
 {
-    if (m_t_float == v)
-        return;
-    m_t_float = v;
-    emit timeInFloatChanged();
+    setRegisterValue(RegTimeInFloat, v);
 }
 
 QString Tsmppt::productName() const
@@ -581,23 +384,38 @@ void Tsmppt::setProductName(QString v)
         return;
     m_name = v;
     emit productNameChanged();
-}
-
-void Tsmppt::onTimeout()
-{
-    mTimer->stop();
-    if (!mInitialized)
-    {
-        initialize();
-    }
-    else
-    {
-        updateValues();
-    }
-    mTimer->start();
+    markChanged(ProductNameValue);
+}
+
+void Tsmppt::setRegisterValue(int reg, double v)
+{
+    // Notify signals in TsmpptRegister order
+    static void (Tsmppt::*const notifySignals[RegisterCount])() = {
+        &Tsmppt::batteryVoltageChanged,
+        &Tsmppt::arrayVoltageChanged,
+        &Tsmppt::arrayCurrentChanged,
+        &Tsmppt::batteryTemperatureChanged,
+        &Tsmppt::chargingCurrentChanged,
+        &Tsmppt::chargeStateChanged,
+        &Tsmppt::wattHoursTotalResettableChanged,
+        &Tsmppt::wattHoursTotalChanged,
+        &Tsmppt::outputPowerChanged,
+        &Tsmppt::batteryVoltageMinDailyChanged,
+        &Tsmppt::batteryVoltageMaxDailyChanged,
+        &Tsmppt::arrayVoltageMaxDailyChanged,
+        &Tsmppt::wattHoursDailyChanged,
+        &Tsmppt::powerMaxDailyChanged,
+        &Tsmppt::timeInAbsorptionChanged,
+        &Tsmppt::timeInFloatChanged
+    };
+    if (m_values[reg] == v)
+        return;
+    m_values[reg] = v;
+    (this->*notifySignals[reg])();
+    markChanged(reg);
 }
 
 void Tsmppt::startLogging()
 {
-    mTimer->start();
+    QMetaObject::invokeMethod(mAcquisition, "start", Qt::QueuedConnection);
 }
@@ -1,11 +1,10 @@
 #ifndef TSMPPT_H
 #define TSMPPT_H
 
-#include <modbus.h>
-#include <stdint.h>
 #include <QObject>
+#include "tsmppt_registers.h"
 
-class QTimer;
+class TsmpptAcquisition;
 
 class Tsmppt : public QObject
 {
@@ -33,11 +32,44 @@ class Tsmppt : public QObject
     Q_PROPERTY(QString hardwareVersion READ hardwareVersion WRITE setHardwareVersion NOTIFY hardwareVersionChanged)
     Q_PROPERTY(QString productName READ productName WRITE setProductName NOTIFY productNameChanged)
     Q_PROPERTY(QString serialNumber READ serialNumber WRITE setSerialNumber NOTIFY serialNumberChanged)
+    Q_PROPERTY(int connected READ connected NOTIFY connectedChanged)
 
 public:
+    /*!
+     * \brief Bit numbers in the change set of `valuesUpdated`. The values read
+     * from registers use their `TsmpptRegister` row.
+     */
+    enum Value {
+        YieldUserValue = RegisterCount,
+        YieldSystemValue,
+        TimeInBulkValue,
+        FirmwareVersionValue,
+        HardwareVersionValue,
+        SerialNumberValue,
+        ProductNameValue,
+        ValueCount
+    };
+
     Tsmppt(const QString &IPAddress, const int port = 502, int interval = 5000, int slave = 1, QObject *parent = 0);
     ~Tsmppt();
 
+    /*!
+     * \brief Switches to another controller (unit `slave` at the address)
+     * without recreating this object. The values are invalid (`connected` is
+     * 0) until it answers.
+     */
+    void setTarget(const QString &IPAddress, int port, int slave);
+
+    /*!
+     * \brief Changes the polling interval of the live values, in ms.
+     */
+    void setInterval(int interval);
+
+    /*!
+     * \brief Changes the maximum time to wait for a reply, in ms.
+     */
+    void setTimeout(int timeout);
+
     double batteryVoltage() const;
     void setBatteryVoltage(double v);
 
@@ -107,9 +139,21 @@ public:
     QString productName() const;
     void setProductName(QString v);
 
-    bool initialize();
+    /*!
+     * \brief 1 while the controller answers, 0 before the first connection
+     * and while reconnecting. The other values are stale while this is 0.
+     */
+    int connected() const;
 
 signals:
+    /*!
+     * \brief Emitted once per poll with the values that have changed.
+     * Bit `n` of `changeSet` is set if the value with `Value` (or
+     * `TsmpptRegister`) number `n` has changed. The per property notify signals
+     * are still emitted before this one.
+     */
+    void valuesUpdated(quint32 changeSet);
+
     void batteryVoltageChanged();
     void batteryVoltageMaxDailyChanged();
     void batteryVoltageMinDailyChanged();
@@ -135,45 +179,33 @@ signals:
     void hardwareVersionChanged();
     void serialNumberChanged();
     void productNameChanged();
+    void connectedChanged();
 
 private slots:
-    void onTimeout();
     void startLogging();
+    void onSnapshotReady();
+    void onConnected();
+    void onConnectionLost();
 
 private:
-    bool readInputRegisters(int addr, int nb, uint16_t *dest);
-    void updateValues();
-    bool mInitialized;
-    QTimer *mTimer;
-    modbus_t *mCtx;
-    uint16_t *mModbusRegs;
-    int m_interval;
-
-    // Dynamic values:
-    double m_v_bat;         // Battery voltage
-    double m_v_bat_max;     // Max battery voltage, daily
-    double m_v_bat_min;     // Min battery voltage, daily
-    double m_t_bat;         // Battery temperature
-    double m_i_cc;          // Charging current
-    double m_v_pv;          // PV array voltage 
-    double m_pout;          // Output power
-    double m_i_pv;          // PV array current
-    double m_p_max;         // Max power, daily
-    double m_whc;           // Watt hours, daily
-    double m_whc_tot;       // Watt hours, total
-    double m_whc_tot_res;   // Watt hours, total resettable
-    double m_v_pv_max;      // Max PV voltage, daily
-    int m_cs;               // Charge state
-    int m_t_abs;            // Time in absorption
-    int m_t_float;          // Time in float
+    TsmpptAcquisition *mAcquisition;
+
+    void setRegisterValue(int reg, double v);
+    void markChanged(int value);
+    void markAllChanged();
+
+    quint32 mChangeSet;
+    int mBatchDepth;
+    bool mConnected;
+
+    // Dynamic values read from the controller, see RegisterMap:
+    double m_values[RegisterCount];
+    // Derived values:
     int m_t_bulk;           // Time in bulk
-    uint32_t m_t_bulk_ms;   // Time in bulk (ms)
     double yield_user;      // Watt hours, total since last reset
     double yield_system;    // Watt hours, total
 
     // Static values (read once):
-    double m_v_pu;          // Voltage scaling
-    double m_i_pu;          // Current scaling
     int m_fw_ver;
     QString m_hw_ver;
     QString m_serial;
@@ -0,0 +1,573 @@
+#include <algorithm>
+#include <QCoreApplication>
+#include <QPointer>
+#include <QsLog.h>
+#include <QThread>
+#include <QTimer>
+#include "modbus_unit.h"
+#include "tsmppt_acquisition.h"
+
+const int REG_V_PU          = 0;
+const int REG_I_PU          = 2;
+const int REG_VER_SW        = 4;
+const int STATIC_COUNT      = 6;
+const int REG_EHW_VERSION   = 57549;
+const int REG_ESERIAL       = 57536;
+const int REG_EMODEL        = 57548;
+
+const int CS_NIGHT          = 3;
+const int CS_BULK           = 5;
+
+// Retries of failed reads per cycle, shared by all reads of the cycle
+const int RETRY_BUDGET      = 2;
+const int DAILY_PERIOD_MS   = 60000;
+const int RECONNECT_MIN_MS  = 1000;
+const int RECONNECT_MAX_MS  = 60000;
+// Minimum growth of the time in bulk before it is written to the cache
+const int BULK_STORE_MS     = 5 * 60000;
+
+/*
+ * Runs the event loop of all acquisition objects. Owned by the application
+ * object, so the thread is stopped before the application exits.
+ */
+class AcquisitionThread : public QThread
+{
+public:
+    AcquisitionThread(QObject *parent):
+        QThread(parent)
+    {
+    }
+
+    ~AcquisitionThread()
+    {
+        quit();
+        wait();
+    }
+};
+
+TsmpptSnapshot::TsmpptSnapshot():
+    timeInBulk(0), yieldUser(0), yieldSystem(0), firmwareVersion(0)
+{
+    for (int i = 0; i < RegisterCount; ++i)
+        values[i] = 0;
+}
+
+TsmpptAcquisition::TsmpptAcquisition(const QString &IPAddress, int port, int interval, int slave):
+    QObject(0),
+    mInitialized(false),
+    mStarted(false),
+    mStopped(false),
+    mTimer(new QTimer(this)),
+    mModbus(new ModbusUnit(IPAddress, port, slave, this)),
+    mStep(Idle),
+    mRetries(0),
+    m_interval(interval),
+    mPollPolicy(interval),
+    mBreaker(RECONNECT_MIN_MS, RECONNECT_MAX_MS),
+    mConnectionLost(false),
+    mLostAtMs(0),
+    mCycleStartMs(0),
+    mLiveGroup(-1),
+    mDailyGroup(-1),
+    mBlocksLeft(0),
+    mCycleRead(false),
+    mLastLiveMs(0),
+    m_v_pu(0),
+    m_i_pu(0),
+    m_t_bulk_ms(0),
+    mStoredBulkMs(0),
+    mCache(IPAddress, port, slave)
+{
+    connect(mModbus, SIGNAL(readFinished(int, QVector<quint16>)),
+            this, SLOT(onReadFinished(int, QVector<quint16>)));
+    connect(mModbus, SIGNAL(readFailed(int, int)), this, SLOT(onReadFailed(int, int)));
+    connect(mModbus, SIGNAL(connected()), this, SLOT(onModbusConnected()));
+    mLiveGroup = mScheduler.addGroup(registerSpanFirst(GroupLive), registerSpanCount(GroupLive),
+                                     m_interval);
+    mDailyGroup = mScheduler.addGroup(registerSpanFirst(GroupDaily), registerSpanCount(GroupDaily),
+                                      qMax(DAILY_PERIOD_MS, m_interval));
+    for (int i = 0; i < ScaleCount; ++i)
+        mScale[i] = 1.0;
+    mDueGroups.reserve(mScheduler.groupCount());
+    mPlanData.reserve(RegisterPlanner::MaxRegisters * mScheduler.groupCount());
+    mTimer->setSingleShot(true);
+    mTimer->setInterval(m_interval);
+    connect(mTimer, SIGNAL(timeout()), this, SLOT(onTimeout()));
+    mClock.start();
+    // Restarted during the day: continue counting
+    m_t_bulk_ms = mCache.timeInBulkMs();
+    mStoredBulkMs = m_t_bulk_ms;
+    mValues.timeInBulk = (int)(m_t_bulk_ms/(1000*60));
+}
+
+SnapshotSlot<TsmpptSnapshot> &TsmpptAcquisition::snapshots()
+{
+    return mSnapshots;
+}
+
+QThread *TsmpptAcquisition::acquisitionThread()
+{
+    // Only called from the main thread
+    static QPointer<QThread> thread;
+    if (thread.isNull()) {
+        thread = new AcquisitionThread(QCoreApplication::instance());
+        thread->start();
+    }
+    return thread;
+}
+
+void TsmpptAcquisition::start()
+{
+    if (mStopped)
+        return;
+    mStarted = true;
+    mTimer->start();
+}
+
+void TsmpptAcquisition::stop()
+{
+    QLOG_DEBUG() << "TsmpptAcquisition::stop()";
+    mStopped = true;
+    mTimer->stop();
+    mStep = Idle;
+    mModbus->disconnectFromDevice();
+    if (m_t_bulk_ms != mStoredBulkMs)
+        mCache.storeTimeInBulk(m_t_bulk_ms);
+}
+
+void TsmpptAcquisition::setTarget(const QString &IPAddress, int port, int slave)
+{
+    if (IPAddress == mModbus->host() && port == mModbus->port() && slave == mModbus->unitId())
+        return;
+    QLOG_INFO() << "TsmpptAcquisition: polling" << IPAddress << "port" << port << "unit" << slave;
+    // Drops the requests in progress, their replies will not be reported.
+    mModbus->setTarget(IPAddress, port, slave);
+    if (m_t_bulk_ms != mStoredBulkMs)
+        mCache.storeTimeInBulk(m_t_bulk_ms);
+    mCache = TsmpptCache(IPAddress, port, slave);
+    // The time in bulk belongs to the controller, continue from its cache.
+    m_t_bulk_ms = mCache.timeInBulkMs();
+    mStoredBulkMs = m_t_bulk_ms;
+    mValues.timeInBulk = (int)(m_t_bulk_ms/(1000*60));
+    mStep = Idle;
+    mCycleRead = false;
+    mBreaker.close();
+    if (mInitialized) {
+        mInitialized = false;
+        emit connectionLost();
+    }
+    if (mStarted && !mStopped)
+        mTimer->start(0);
+}
+
+void TsmpptAcquisition::setInterval(int interval)
+{
+    if (interval <= 0 || interval == m_interval)
+        return;
+    QLOG_INFO() << "TsmpptAcquisition: interval" << interval << "ms";
+    m_interval = interval;
+    mPollPolicy.setBaseInterval(interval);
+    qint64 now = mClock.elapsed();
+    mScheduler.setPeriod(mLiveGroup, interval, now);
+    mScheduler.setPeriod(mDailyGroup, qMax(DAILY_PERIOD_MS, interval), now);
+    // A cycle in progress picks up the new deadlines in finishCycle.
+    if (mStep == Idle && mInitialized && mTimer->isActive()) {
+        qint64 wait = mScheduler.nextDeadline() - now;
+        mTimer->start(wait > 0 ? (int)wait : 0);
+    }
+}
+
+void TsmpptAcquisition::setTimeout(int timeout)
+{
+    if (timeout <= 0 || timeout == mModbus->responseTimeout())
+        return;
+    QLOG_INFO() << "TsmpptAcquisition: response timeout at most" << timeout << "ms";
+    mModbus->setResponseTimeout(timeout);
+}
+
+void TsmpptAcquisition::onTimeout()
+{
+    if (mStep != Idle || mStopped)
+        return;
+    // The delay after a failure has passed, try a single read.
+    mBreaker.probe();
+    if (!mInitialized)
+    {
+        initialize();
+    }
+    else
+    {
+        updateValues();
+    }
+}
+
+void TsmpptAcquisition::onReadFailed(int address, int error)
+{
+    if (mStep == Idle)
+        return;
+    int block = RegisterPlanner::findBlock(mPlan, address);
+    if (block < 0)
+        return;
+    // A probe is not retried, the device is already known to be down.
+    if (error != ModbusTcpClient::ConnectError && mBreaker.state() == CircuitBreaker::Closed &&
+            mRetries > 0)
+    {
+        --mRetries;
+        QLOG_ERROR() << "MODBUS:" << mModbus->errorString() << "Retrying (" << RETRY_BUDGET-mRetries
+                     << ") with timeout" << mModbus->rtt().timeout() << "ms...";
+        mModbus->readInputRegisters(address, mPlan[block].count);
+        return;
+    }
+    // The device is not reachable: a connect failed, or the retries of this
+    // cycle are spent.
+    QLOG_ERROR() << "MODBUS:" << mModbus->errorString();
+    mModbus->disconnectFromDevice();
+    scheduleReconnect();
+}
+
+void TsmpptAcquisition::scheduleReconnect()
+{
+    // Values read in this cycle are dropped, the bridge invalidates them anyway.
+    mStep = Idle;
+    mCycleRead = false;
+    if (mStopped)
+        return;
+    if (mInitialized) {
+        // Identity and scaling are read again, the controller may be replaced.
+        mInitialized = false;
+        mConnectionLost = true;
+        mLostAtMs = mClock.elapsed();
+        QLOG_INFO() << "MODBUS: connection loss detected in" << mLostAtMs - mCycleStartMs << "ms";
+        emit connectionLost();
+    }
+    int delay = mBreaker.trip();
+    QLOG_INFO() << "MODBUS: reconnecting to" << mModbus->host() << "in" << delay
+                << "ms (attempt" << mBreaker.trips() << ")";
+    mTimer->start(delay);
+}
+
+void TsmpptAcquisition::onReadFinished(int address, const QVector<quint16> &registers)
+{
+    if (mStep == Idle)
+        return;
+    // Replies may arrive in any order
+    int block = RegisterPlanner::findBlock(mPlan, address);
+    if (block < 0 || mPlan[block].first != address || registers.size() != mPlan[block].count)
+        return;
+    std::copy(registers.constBegin(), registers.constEnd(), mPlanData.begin() + mPlanOffsets[block]);
+    if (--mBlocksLeft == 0)
+        finishPlan();
+}
+
+void TsmpptAcquisition::startPlan(Step step)
+{
+    // A round trip costs the smoothed RTT, in the planner's microseconds
+    const RttEstimator &rtt = mModbus->rtt();
+    if (rtt.hasSamples())
+        mPlanner.setCostModel(rtt.srtt() * 1000, mPlanner.registerCost());
+    mPlanner.plan(mPlan);
+    mPlanOffsets.resize(mPlan.size());
+    int size = 0;
+    for (int i = 0; i < mPlan.size(); ++i) {
+        mPlanOffsets[i] = size;
+        size += mPlan[i].count;
+    }
+    mPlanData.resize(size);
+    mBlocksLeft = mPlan.size();
+    mRetries = RETRY_BUDGET;
+    mCycleStartMs = mClock.elapsed();
+    mStep = step;
+    if (mBlocksLeft == 0) {
+        finishPlan();
+        return;
+    }
+    // All reads are queued at once, the client pipelines them.
+    for (int i = 0; i < mPlan.size() && mStep == step; ++i)
+        mModbus->readInputRegisters(mPlan[i].first, mPlan[i].count);
+}
+
+const quint16 *TsmpptAcquisition::planRegisters(int address) const
+{
+    // Each span added to the planner lies within one block.
+    int block = RegisterPlanner::findBlock(mPlan, address);
+    Q_ASSERT(block >= 0);
+    return mPlanData.constData() + mPlanOffsets[block] + address - mPlan[block].first;
+}
+
+void TsmpptAcquisition::finishPlan()
+{
+    switch (mStep)
+    {
+        case ReadIdentity:
+        {
+            decodeStatic(planRegisters(REG_V_PU));
+            quint16 hw = *planRegisters(REG_EHW_VERSION);
+            mValues.hardwareVersion = QString::number(hw >> 8) + "." + QString::number(hw & 0xff);
+            mValues.productName = decodeProductName(*planRegisters(REG_EMODEL));
+            mValues.serialNumber = decodeSerial(planRegisters(REG_ESERIAL));
+            storeIdentity();
+            finishInitialize();
+            break;
+        }
+
+        case VerifySerial:
+        {
+            QString serial = decodeSerial(planRegisters(REG_ESERIAL));
+            if (serial == mValues.serialNumber) {
+                finishInitialize();
+                break;
+            }
+            QLOG_INFO() << "TsmpptAcquisition: serial" << serial << "does not match cached"
+                        << mValues.serialNumber << ", reading identity";
+            mCache.clear();
+            readIdentity();
+            break;
+        }
+
+        case ReadGroup:
+            foreach (int group, mDueGroups) {
+                if (group == mLiveGroup)
+                    decodeLive(planRegisters(registerSpanFirst(GroupLive)));
+                else if (group == mDailyGroup)
+                    decodeDaily(planRegisters(registerSpanFirst(GroupDaily)));
+            }
+            mCycleRead = !mDueGroups.isEmpty();
+            QLOG_DEBUG() << "TsmpptAcquisition: cycle of" << mPlan.size() << "reads took"
+                         << mClock.elapsed() - mCycleStartMs << "ms, window" << mModbus->window();
+            finishCycle();
+            break;
+
+        case Idle:
+            break;
+    }
+}
+
+QString TsmpptAcquisition::decodeProductName(quint16 model)
+{
+    switch (model)
+    {
+        case 0:
+            return "TriStar MPPT 45";
+
+        case 1:
+            return "TriStar MPPT 60";
+
+        case 2:
+            return "TriStar MPPT 30";
+
+        default:
+            return "";
+    }
+}
+
+void TsmpptAcquisition::onModbusConnected()
+{
+    const ModbusTcpClient::Statistics &stats = mModbus->statistics();
+    QLOG_INFO() << "MODBUS: connected to" << mModbus->host() << "port" << mModbus->port()
+                << "unit" << mModbus->unitId()
+                << "in" << stats.lastHandshakeMs << "ms (connection" << stats.connects
+                << ", avg handshake" << stats.averageHandshakeMs() << "ms, reuse ratio"
+                << stats.reuseRatio() << ", avg lookup" << stats.averageLookupMs() << "ms for"
+                << stats.lookups << "lookups," << stats.cachedLookups << "cached)";
+}
+
+void TsmpptAcquisition::publish()
+{
+    if (mStopped)
+        return;
+    mSnapshots.writeBuffer() = mValues;
+    mSnapshots.publish();
+    emit snapshotReady();
+}
+
+void TsmpptAcquisition::finishCycle()
+{
+    // The Modbus connection is kept open for the next cycle.
+    mStep = Idle;
+    if (mCycleRead)
+        publish();
+    mCycleRead = false;
+    if (mStopped)
+        return;
+    if (!mInitialized) {
+        mTimer->start(m_interval);
+        return;
+    }
+    qint64 wait = mScheduler.nextDeadline() - mClock.elapsed();
+    mTimer->start(wait > 0 ? (int)wait : 0);
+}
+
+void TsmpptAcquisition::initialize()
+{
+    QLOG_DEBUG() << "TsmpptAcquisition::initialize(start)";
+
+    TsmpptIdentity identity;
+    if (mCache.load(identity)) {
+        // Publish the identity right away, and only check that the
+        // controller has not been replaced.
+        bool changed = identity.serialNumber != mValues.serialNumber;
+        m_v_pu = identity.voltageScale;
+        m_i_pu = identity.currentScale;
+        updateScale();
+        mValues.firmwareVersion = identity.firmwareVersion;
+        mValues.hardwareVersion = identity.hardwareVersion;
+        mValues.productName = identity.productName;
+        mValues.serialNumber = identity.serialNumber;
+        if (changed)
+            publish();
+        mPlanner.clear();
+        mPlanner.addSpan(REG_ESERIAL, 4);
+        startPlan(VerifySerial);
+        return;
+    }
+    readIdentity();
+}
+
+void TsmpptAcquisition::readIdentity()
+{
+    mPlanner.clear();
+    mPlanner.addSpan(REG_V_PU, STATIC_COUNT);
+    mPlanner.addSpan(REG_ESERIAL, 4);
+    mPlanner.addSpan(REG_EMODEL, 1);
+    mPlanner.addSpan(REG_EHW_VERSION, 1);
+    startPlan(ReadIdentity);
+    QLOG_INFO() << "TsmpptAcquisition: identity" << mPlanner.spanCount() << "reads planned as"
+                << mPlan.size();
+}
+
+void TsmpptAcquisition::finishInitialize()
+{
+    mInitialized = true;
+    if (mConnectionLost) {
+        QLOG_INFO() << "MODBUS: connection restored after"
+                    << mClock.elapsed() - mLostAtMs << "ms and"
+                    << mBreaker.trips() << "attempts";
+        mConnectionLost = false;
+    }
+    mBreaker.close();
+    publish();
+    // Read all groups right away, then continue on the fixed-rate grid.
+    mScheduler.reset(mClock.elapsed());
+    mLastLiveMs = mClock.elapsed();
+    finishCycle();
+    emit tsmpptConnected();
+    QLOG_DEBUG() << "TsmpptAcquisition::initialize(end)";
+    QString logmsg = mValues.productName + " (serial #" + mValues.serialNumber + ", controler v" + mValues.hardwareVersion + "." + mValues.firmwareVersion + ") connected";
+    QLOG_INFO() << logmsg.toStdString().c_str();
+}
+
+QString TsmpptAcquisition::decodeSerial(const quint16 *regs)
+{
+    uint64_t serial = (uint64_t)((regs[0] & 0xff) - 0x30) * 10000000;
+    serial += (uint64_t)((regs[0] >> 8) - 0x30) * 1000000;
+    serial += (uint64_t)((regs[1] & 0xff) - 0x30) * 100000;
+    serial += (uint64_t)((regs[1] >> 8) - 0x30) * 10000;
+    serial += (uint64_t)((regs[2] & 0xff) - 0x30) * 1000;
+    serial += (uint64_t)((regs[2] >> 8) - 0x30) * 100;
+    serial += (uint64_t)((regs[3] & 0xff) - 0x30) * 10;
+    serial += (uint64_t)((regs[3] >> 8) - 0x30);
+    return QString::number(serial);
+}
+
+void TsmpptAcquisition::storeIdentity()
+{
+    TsmpptIdentity identity;
+    identity.voltageScale = m_v_pu;
+    identity.currentScale = m_i_pu;
+    identity.firmwareVersion = mValues.firmwareVersion;
+    identity.hardwareVersion = mValues.hardwareVersion;
+    identity.productName = mValues.productName;
+    identity.serialNumber = mValues.serialNumber;
+    mCache.store(identity);
+}
+
+void TsmpptAcquisition::decodeStatic(const quint16 *regs)
+{
+    // Voltage scaling:
+    m_v_pu = (float)regs[1];
+    m_v_pu /= 65536.0;
+    m_v_pu += (float)regs[0];
+
+    // Current scaling:
+    m_i_pu = (float)regs[3];
+    m_i_pu /= 65536.0;
+    m_i_pu += (float)regs[2];
+    QLOG_DEBUG() << "Tsmppt: m_v_pu =" << m_v_pu << " m_i_pu =" << m_i_pu;
+    updateScale();
+
+    // Firmware version:
+    uint16_t ver = ((regs[4] >> 12) & 0x0f) * 1000;
+    ver += ((regs[4] >> 8) & 0x0f) * 100;
+    ver += ((regs[4] >> 4) & 0x0f) * 10;
+    ver += regs[4] & 0x0f;
+    mValues.firmwareVersion = ver;
+}
+
+void TsmpptAcquisition::updateScale()
+{
+    mScale[ScaleNone] = 1.0;
+    mScale[ScaleVoltage] = m_v_pu / 32768.0;
+    mScale[ScaleCurrent] = m_i_pu / 32768.0;
+    mScale[ScalePower] = m_v_pu * m_i_pu / 131072.0;
+    mScale[ScaleKilo] = 1.0 / 1000.0;
+    mScale[ScaleMinutes] = 1.0 / 60.0;
+}
+
+void TsmpptAcquisition::updateValues()
+{
+    QLOG_DEBUG() << "TsmpptAcquisition::updateValues() requests" << mModbus->statistics().requests
+                 << "pipelined" << mModbus->statistics().pipelinedRequests
+                 << "connects" << mModbus->statistics().connects << "timeouts"
+                 << mModbus->statistics().timeouts << "srtt" << mModbus->rtt().srtt() << "ms";
+
+    mScheduler.takeDue(mClock.elapsed(), mDueGroups);
+    mCycleRead = false;
+    mPlanner.clear();
+    foreach (int group, mDueGroups)
+        mPlanner.addSpan(mScheduler.firstRegister(group), mScheduler.registerCount(group));
+    startPlan(ReadGroup);
+    QLOG_DEBUG() << "TsmpptAcquisition: round trips" << mPlanner.spanCount() << "planned as"
+                 << mPlan.size();
+}
+
+void TsmpptAcquisition::decodeLive(const quint16 *reg)
+{
+    TsmpptSnapshot &v = mValues;
+    decodeRegisters<GroupLive>(reg, mScale, v.values);
+    v.yieldUser = v.values[RegWattHoursDaily] + v.values[RegWattHoursTotalResettable];
+    v.yieldSystem = v.values[RegWattHoursDaily] + v.values[RegWattHoursTotal];
+
+    // Time in bulk, measured between live reads:
+    int chargeState = (int)v.values[RegChargeState];
+    qint64 now = mClock.elapsed();
+    if (chargeState == CS_BULK)
+        m_t_bulk_ms += now - mLastLiveMs;
+    else if (chargeState == CS_NIGHT)
+        m_t_bulk_ms = 0;
+    mLastLiveMs = now;
+    v.timeInBulk = (int)(m_t_bulk_ms/(1000*60));
+
+    int interval = mPollPolicy.update(chargeState, v.values[RegArrayVoltage],
+                                      v.values[RegOutputPower]);
+    if (interval != mScheduler.period(mLiveGroup)) {
+        QLOG_DEBUG() << "TsmpptAcquisition: charge state" << chargeState
+                     << "live interval" << interval << "ms";
+        mScheduler.setPeriod(mLiveGroup, interval, now);
+        mScheduler.setPeriod(mDailyGroup, qMax(DAILY_PERIOD_MS, interval), now);
+    }
+}
+
+void TsmpptAcquisition::decodeDaily(const quint16 *reg)
+{
+    TsmpptSnapshot &v = mValues;
+    decodeRegisters<GroupDaily>(reg, mScale, v.values);
+    v.yieldUser = v.values[RegWattHoursDaily] + v.values[RegWattHoursTotalResettable];
+    v.yieldSystem = v.values[RegWattHoursDaily] + v.values[RegWattHoursTotal];
+
+    // Only after a few minutes more in bulk (or the reset at night), to keep
+    // writes to flash memory rare.
+    if (m_t_bulk_ms < mStoredBulkMs || m_t_bulk_ms - mStoredBulkMs >= (uint32_t)BULK_STORE_MS) {
+        mCache.storeTimeInBulk(m_t_bulk_ms);
+        mStoredBulkMs = m_t_bulk_ms;
+    }
+}
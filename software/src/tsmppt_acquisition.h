@@ -0,0 +1,186 @@
+#ifndef TSMPPT_ACQUISITION_H
+#define TSMPPT_ACQUISITION_H
+
+#include <stdint.h>
+#include <QElapsedTimer>
+#include <QObject>
+#include <QString>
+#include <QVector>
+#include "adaptive_poll_policy.h"
+#include "circuit_breaker.h"
+#include "register_planner.h"
+#include "register_scheduler.h"
+#include "snapshot_slot.h"
+#include "tsmppt_cache.h"
+#include "tsmppt_registers.h"
+
+class ModbusUnit;
+class QThread;
+class QTimer;
+
+/*!
+ * \brief Decoded values of one poll of the charge controller.
+ */
+struct TsmpptSnapshot
+{
+    TsmpptSnapshot();
+
+    // Dynamic values, indexed by TsmpptRegister:
+    double values[RegisterCount];
+    // Derived values:
+    int timeInBulk;
+    double yieldUser;
+    double yieldSystem;
+
+    // Static values:
+    int firmwareVersion;
+    QString hardwareVersion;
+    QString serialNumber;
+    QString productName;
+};
+
+/*!
+ * \brief Polls a Tristar MPPT over Modbus-TCP.
+ * All Modbus I/O and decoding is done by this object, which lives in the
+ * acquisition thread (see `acquisitionThread()`). The static values are read
+ * once after connecting, or taken from `TsmpptCache` if the serial number of
+ * the controller matches the cached one. After that the live values are read every
+ * `interval` ms and the daily statistics once a minute, on a fixed-rate
+ * schedule. The live interval is adapted to the charge state by
+ * `AdaptivePollPolicy`. All reads go through `RegisterPlanner`, which merges
+ * the wanted registers (for example the live and daily values when both are
+ * due) into as few Modbus transactions as possible. The reads of a cycle are
+ * sent at once and pipelined by `ModbusTcpClient`. Controllers behind the
+ * same gateway share its connection through `ModbusUnit`, each with its own
+ * unit ID and decoding state. Each completed poll is published as a
+ * `TsmpptSnapshot` in `snapshots()`, followed by the `snapshotReady` signal.
+ * Failed reads are retried from a small budget per cycle. When the budget is
+ * spent or the controller cannot be reached, `connectionLost` is emitted and
+ * `CircuitBreaker` keeps the controller alone until the next probe. After
+ * reconnecting the static values are read again, followed by
+ * `tsmpptConnected`.
+ * The address and unit ID of the controller, the polling interval and the
+ * response timeout can be changed while polling, through `setTarget`,
+ * `setInterval` and `setTimeout`.
+ * The slots of this class must be invoked through queued connections from
+ * other threads.
+ */
+class TsmpptAcquisition : public QObject
+{
+    Q_OBJECT
+public:
+    TsmpptAcquisition(const QString &IPAddress, int port, int interval, int slave);
+
+    /*!
+     * \brief Consumer side of the snapshot handoff. Only one thread may read
+     * from it.
+     */
+    SnapshotSlot<TsmpptSnapshot> &snapshots();
+
+    /*!
+     * \brief The thread shared by all acquisition objects. It is created on
+     * first use and stopped when the application object is destroyed.
+     */
+    static QThread *acquisitionThread();
+
+public slots:
+    void start();
+
+    /*!
+     * \brief Stops polling and closes the connection. No snapshots will be
+     * published after this slot returns.
+     */
+    void stop();
+
+    /*!
+     * \brief Polls unit `slave` at `IPAddress`:`port` from now on. Handled
+     * like a lost connection: the values are invalid until the controller
+     * answers.
+     */
+    void setTarget(const QString &IPAddress, int port, int slave);
+
+    /*!
+     * \brief Changes the base interval of the live values.
+     */
+    void setInterval(int interval);
+
+    /*!
+     * \brief Changes the maximum time to wait for a reply, in ms. The actual
+     * timeout follows the measured round trip times.
+     */
+    void setTimeout(int timeout);
+
+signals:
+    void snapshotReady();
+    void tsmpptConnected();
+    void connectionLost();
+
+private slots:
+    void onTimeout();
+    void onReadFinished(int address, const QVector<quint16> &regs);
+    void onReadFailed(int address, int error);
+    void onModbusConnected();
+
+private:
+    // Planned reads performed in one timer cycle:
+    enum Step {
+        Idle,
+        ReadIdentity,
+        VerifySerial,       // Cached identity, check the serial number only
+        ReadGroup
+    };
+
+    void initialize();
+    void readIdentity();
+    void finishInitialize();
+    static QString decodeSerial(const quint16 *regs);
+    static QString decodeProductName(quint16 model);
+    void storeIdentity();
+    void updateScale();
+    void updateValues();
+    void startPlan(Step step);
+    void finishPlan();
+    const quint16 *planRegisters(int address) const;
+    void decodeStatic(const quint16 *regs);
+    void decodeLive(const quint16 *reg);
+    void decodeDaily(const quint16 *reg);
+    void publish();
+    void finishCycle();
+    void scheduleReconnect();
+
+    bool mInitialized;
+    bool mStarted;
+    bool mStopped;
+    QTimer *mTimer;
+    ModbusUnit *mModbus;
+    Step mStep;
+    int mRetries;           // Retries left in this cycle
+    int m_interval;
+    RegisterScheduler mScheduler;
+    AdaptivePollPolicy mPollPolicy;
+    CircuitBreaker mBreaker;
+    bool mConnectionLost;
+    qint64 mLostAtMs;
+    qint64 mCycleStartMs;
+    int mLiveGroup;
+    int mDailyGroup;
+    QVector<int> mDueGroups;
+    RegisterPlanner mPlanner;
+    QVector<RegisterPlanner::Block> mPlan;
+    QVector<int> mPlanOffsets;  // Offset of each block of mPlan in mPlanData
+    QVector<quint16> mPlanData;
+    int mBlocksLeft;
+    bool mCycleRead;
+    QElapsedTimer mClock;
+    qint64 mLastLiveMs;
+    double m_v_pu;          // Voltage scaling
+    double m_i_pu;          // Current scaling
+    double mScale[ScaleCount];
+    uint32_t m_t_bulk_ms;   // Time in bulk (ms)
+    uint32_t mStoredBulkMs; // Time in bulk in mCache
+    TsmpptCache mCache;
+    TsmpptSnapshot mValues;
+    SnapshotSlot<TsmpptSnapshot> mSnapshots;
+};
+
+#endif // TSMPPT_ACQUISITION_H
@@ -0,0 +1,82 @@
+#include <QDate>
+#include <QScopedPointer>
+#include <QSettings>
+#include "tsmppt_cache.h"
+
+QString TsmpptCache::mFileName;
+
+static QSettings *openSettings(const QString &fileName)
+{
+    if (fileName.isEmpty())
+        return new QSettings(QSettings::IniFormat, QSettings::UserScope, "dbus-tsmppt", "cache");
+    return new QSettings(fileName, QSettings::IniFormat);
+}
+
+TsmpptIdentity::TsmpptIdentity():
+    voltageScale(0), currentScale(0), firmwareVersion(0)
+{
+}
+
+TsmpptCache::TsmpptCache(const QString &host, int port, int unitId):
+    // '/' and '\' separate groups in QSettings
+    mGroup(QString(host).replace('/', '_').replace('\\', '_') + "_" + QString::number(port) +
+           "_" + QString::number(unitId))
+{
+}
+
+void TsmpptCache::setFileName(const QString &fileName)
+{
+    mFileName = fileName;
+}
+
+bool TsmpptCache::load(TsmpptIdentity &identity) const
+{
+    QScopedPointer<QSettings> settings(openSettings(mFileName));
+    settings->beginGroup(mGroup);
+    if (!settings->contains("SerialNumber"))
+        return false;
+    identity.voltageScale = settings->value("VoltageScale").toDouble();
+    identity.currentScale = settings->value("CurrentScale").toDouble();
+    identity.firmwareVersion = settings->value("FirmwareVersion").toInt();
+    identity.hardwareVersion = settings->value("HardwareVersion").toString();
+    identity.productName = settings->value("ProductName").toString();
+    identity.serialNumber = settings->value("SerialNumber").toString();
+    // Scaling of 0 would zero all values, read it from the controller instead
+    return identity.voltageScale > 0 && identity.currentScale > 0;
+}
+
+void TsmpptCache::store(const TsmpptIdentity &identity)
+{
+    QScopedPointer<QSettings> settings(openSettings(mFileName));
+    settings->beginGroup(mGroup);
+    settings->setValue("VoltageScale", identity.voltageScale);
+    settings->setValue("CurrentScale", identity.currentScale);
+    settings->setValue("FirmwareVersion", identity.firmwareVersion);
+    settings->setValue("HardwareVersion", identity.hardwareVersion);
+    settings->setValue("ProductName", identity.productName);
+    settings->setValue("SerialNumber", identity.serialNumber);
+}
+
+quint32 TsmpptCache::timeInBulkMs() const
+{
+    QScopedPointer<QSettings> settings(openSettings(mFileName));
+    settings->beginGroup(mGroup);
+    // The controller resets the time in bulk at night
+    if (settings->value("TimeInBulkDate").toDate() != QDate::currentDate())
+        return 0;
+    return settings->value("TimeInBulkMs").toUInt();
+}
+
+void TsmpptCache::storeTimeInBulk(quint32 ms)
+{
+    QScopedPointer<QSettings> settings(openSettings(mFileName));
+    settings->beginGroup(mGroup);
+    settings->setValue("TimeInBulkMs", ms);
+    settings->setValue("TimeInBulkDate", QDate::currentDate());
+}
+
+void TsmpptCache::clear()
+{
+    QScopedPointer<QSettings> settings(openSettings(mFileName));
+    settings->remove(mGroup);
+}
@@ -0,0 +1,68 @@
+#ifndef TSMPPT_CACHE_H
+#define TSMPPT_CACHE_H
+
+#include <QString>
+
+/*!
+ * \brief Static values of a charge controller, as stored in `TsmpptCache`.
+ */
+struct TsmpptIdentity
+{
+    TsmpptIdentity();
+
+    double voltageScale;    // V_PU
+    double currentScale;    // I_PU
+    int firmwareVersion;
+    QString hardwareVersion;
+    QString productName;
+    QString serialNumber;
+};
+
+/*!
+ * \brief Disk cache of the static values of the controller at an address.
+ * The entry of a controller is keyed by host, port and unit ID, and holds the
+ * serial number so a replaced controller can be detected with a single read.
+ * Besides the identity and scaling, the time in bulk of the current day is
+ * kept, so it survives a restart of the service.
+ * The cache is an ini file, written through QSettings. Each object may only be
+ * used by one thread at a time.
+ */
+class TsmpptCache
+{
+public:
+    TsmpptCache(const QString &host, int port, int unitId);
+
+    /*!
+     * \brief Sets the cache file of all caches created afterwards. By default
+     * the file is in the user configuration directory.
+     */
+    static void setFileName(const QString &fileName);
+
+    /*!
+     * \brief Loads the identity of the controller.
+     * \retval false if there is no entry for the address.
+     */
+    bool load(TsmpptIdentity &identity) const;
+
+    void store(const TsmpptIdentity &identity);
+
+    /*!
+     * \brief Returns the time in bulk stored today, or 0.
+     */
+    quint32 timeInBulkMs() const;
+
+    void storeTimeInBulk(quint32 ms);
+
+    /*!
+     * \brief Removes the entry of the controller, used when its serial number
+     * does not match.
+     */
+    void clear();
+
+private:
+    QString mGroup;
+
+    static QString mFileName;
+};
+
+#endif // TSMPPT_CACHE_H
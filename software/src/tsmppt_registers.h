@@ -0,0 +1,216 @@
+#ifndef TSMPPT_REGISTERS_H
+#define TSMPPT_REGISTERS_H
+
+#include <float.h>
+#include <stdint.h>
+#include <QtGlobal>
+
+/*
+ * Register map of the Tristar MPPT.
+ * Every dynamic value read from the controller is described by one row of
+ * `RegisterMap`: where it lives, how it is decoded and how it is published on
+ * the D-Bus. The read spans of the register groups and the decoder are derived
+ * from the table at compile time, so adding a register only takes a new row
+ * (plus the Q_PROPERTY in Tsmppt which exposes it).
+ */
+
+/*!
+ * \brief Row index in `RegisterMap`. Rows must be listed in this order.
+ */
+enum TsmpptRegister {
+    // Live values
+    RegBatteryVoltage,
+    RegArrayVoltage,
+    RegArrayCurrent,
+    RegBatteryTemperature,
+    RegChargingCurrent,
+    RegChargeState,
+    RegWattHoursTotalResettable,
+    RegWattHoursTotal,
+    RegOutputPower,
+    // Daily statistics
+    RegBatteryVoltageMinDaily,
+    RegBatteryVoltageMaxDaily,
+    RegArrayVoltageMaxDaily,
+    RegWattHoursDaily,
+    RegPowerMaxDaily,
+    RegTimeInAbsorption,
+    RegTimeInFloat,
+    RegisterCount
+};
+
+/*!
+ * \brief Scaling applied to the raw register value.
+ */
+enum RegisterScale {
+    ScaleNone,          // Raw value
+    ScaleVoltage,       // * V_PU / 2^15
+    ScaleCurrent,       // * I_PU / 2^15
+    ScalePower,         // * V_PU * I_PU / 2^17
+    ScaleKilo,          // / 1000 (Wh to kWh)
+    ScaleMinutes,       // / 60 (s to min)
+    ScaleCount
+};
+
+/*!
+ * \brief True if values of scale `s` are published in whole units.
+ */
+constexpr bool isWholeUnitScale(RegisterScale s)
+{
+    return s == ScaleMinutes;
+}
+
+/*!
+ * \brief Registers of one group are read in a single span and at the same
+ * rate. Rows of a group must be adjacent in `RegisterMap`.
+ */
+enum RegisterGroup {
+    GroupLive,
+    GroupDaily
+};
+
+struct RegisterDef
+{
+    TsmpptRegister id;
+    uint16_t address;
+    bool isSigned;
+    RegisterScale scale;
+    double minimum;         // Decoded values are clamped to this minimum
+    RegisterGroup group;
+    const char *property;   // Tsmppt property
+    const char *path;       // D-Bus path, 0 if not published
+    const char *unit;
+    int precision;
+};
+
+constexpr RegisterDef RegisterMap[] = {
+    { RegBatteryVoltage, 24, false, ScaleVoltage, -DBL_MAX, GroupLive,
+      "batteryVoltage", "/Dc/0/Voltage", "V", 2 },
+    { RegArrayVoltage, 27, false, ScaleVoltage, -DBL_MAX, GroupLive,
+      "arrayVoltage", "/Pv/V", "V", 2 },
+    { RegArrayCurrent, 29, false, ScaleCurrent, -DBL_MAX, GroupLive,
+      "arrayCurrent", "/Pv/I", "A", 2 },
+    { RegBatteryTemperature, 37, true, ScaleNone, -DBL_MAX, GroupLive,
+      "batteryTemperature", "/Dc/0/Temperature", "", -1 },
+    { RegChargingCurrent, 39, true, ScaleCurrent, 0.0, GroupLive,
+      "chargingCurrent", "/Dc/0/Current", "A", 2 },
+    { RegChargeState, 50, false, ScaleNone, -DBL_MAX, GroupLive,
+      "chargeState", "/State", "", -1 },
+    { RegWattHoursTotalResettable, 56, false, ScaleNone, -DBL_MAX, GroupLive,
+      "wattHoursTotalResettable", 0, "kWh", 0 },
+    { RegWattHoursTotal, 57, false, ScaleNone, -DBL_MAX, GroupLive,
+      "wattHoursTotal", 0, "kWh", 0 },
+    { RegOutputPower, 58, false, ScalePower, -DBL_MAX, GroupLive,
+      "outputPower", "/Yield/Power", "W", 0 },
+
+    { RegBatteryVoltageMinDaily, 64, false, ScaleVoltage, -DBL_MAX, GroupDaily,
+      "batteryVoltageMinDaily", "/History/Daily/0/MinBatteryVoltage", "V", 2 },
+    { RegBatteryVoltageMaxDaily, 65, false, ScaleVoltage, -DBL_MAX, GroupDaily,
+      "batteryVoltageMaxDaily", "/History/Daily/0/MaxBatteryVoltage", "V", 2 },
+    { RegArrayVoltageMaxDaily, 66, false, ScaleVoltage, -DBL_MAX, GroupDaily,
+      "arrayVoltageMaxDaily", "/History/Daily/0/MaxPvVoltage", "V", 2 },
+    { RegWattHoursDaily, 68, false, ScaleKilo, -DBL_MAX, GroupDaily,
+      "wattHoursDaily", "/History/Daily/0/Yield", "kWh", 2 },
+    { RegPowerMaxDaily, 70, false, ScalePower, -DBL_MAX, GroupDaily,
+      "powerMaxDaily", "/History/Daily/0/MaxPower", "W", 0 },
+    { RegTimeInAbsorption, 77, false, ScaleMinutes, -DBL_MAX, GroupDaily,
+      "timeInAbsorption", "/History/Daily/0/TimeInAbsorption", "", -1 },
+    { RegTimeInFloat, 79, false, ScaleMinutes, -DBL_MAX, GroupDaily,
+      "timeInFloat", "/History/Daily/0/TimeInFloat", "", -1 }
+};
+
+const int MaxRegistersPerRead = 125;
+
+constexpr bool registerMapValid(int i = 0)
+{
+    return i == RegisterCount ||
+           (RegisterMap[i].id == i &&
+            (i == 0 || RegisterMap[i - 1].group <= RegisterMap[i].group) &&
+            registerMapValid(i + 1));
+}
+
+static_assert(sizeof(RegisterMap) / sizeof(RegisterMap[0]) == RegisterCount,
+              "RegisterMap must have one row per TsmpptRegister");
+static_assert(registerMapValid(),
+              "RegisterMap rows must follow TsmpptRegister and be sorted by group");
+
+constexpr int registerGroupBegin(RegisterGroup g, int i = 0)
+{
+    return i == RegisterCount || RegisterMap[i].group == g ? i : registerGroupBegin(g, i + 1);
+}
+
+constexpr int registerGroupEnd(RegisterGroup g, int i)
+{
+    return i == RegisterCount || RegisterMap[i].group != g ? i : registerGroupEnd(g, i + 1);
+}
+
+constexpr int registerGroupEnd(RegisterGroup g)
+{
+    return registerGroupEnd(g, registerGroupBegin(g));
+}
+
+constexpr int minRegisterAddress(int begin, int end)
+{
+    return begin + 1 >= end ? RegisterMap[begin].address :
+           (RegisterMap[begin].address < minRegisterAddress(begin + 1, end) ?
+            RegisterMap[begin].address : minRegisterAddress(begin + 1, end));
+}
+
+constexpr int maxRegisterAddress(int begin, int end)
+{
+    return begin + 1 >= end ? RegisterMap[begin].address :
+           (RegisterMap[begin].address > maxRegisterAddress(begin + 1, end) ?
+            RegisterMap[begin].address : maxRegisterAddress(begin + 1, end));
+}
+
+/*!
+ * \brief First register of the span read for group `g`.
+ */
+constexpr int registerSpanFirst(RegisterGroup g)
+{
+    return minRegisterAddress(registerGroupBegin(g), registerGroupEnd(g));
+}
+
+/*!
+ * \brief Number of registers in the span read for group `g`.
+ */
+constexpr int registerSpanCount(RegisterGroup g)
+{
+    return maxRegisterAddress(registerGroupBegin(g), registerGroupEnd(g)) -
+           registerSpanFirst(g) + 1;
+}
+
+static_assert(registerSpanCount(GroupLive) <= MaxRegistersPerRead &&
+              registerSpanCount(GroupDaily) <= MaxRegistersPerRead,
+              "Register span too large for a single Modbus read");
+
+/*!
+ * \brief Decodes the span of group `G`.
+ * \param regs The registers read from `registerSpanFirst(G)` onwards.
+ * \param scale Scale factors indexed by `RegisterScale`.
+ * \param values Decoded values indexed by `TsmpptRegister`. Only the rows of
+ * group `G` are written.
+ */
+template<RegisterGroup G>
+inline void decodeRegisters(const uint16_t *regs, const double *scale, double *values)
+{
+    const int first = registerSpanFirst(G);
+    const int end = registerGroupEnd(G);
+    for (int i = registerGroupBegin(G); i < end; ++i) {
+        const RegisterDef &r = RegisterMap[i];
+        // Sign extension without branching: signMask is 0x8000 for signed
+        // registers and 0 otherwise.
+        int32_t signMask = (int32_t)r.isSigned << 15;
+        int32_t raw = ((int32_t)regs[r.address - first] ^ signMask) - signMask;
+        double v = raw * scale[r.scale];
+        // Times are stored in whole minutes, so a new fraction is not seen as
+        // a change. The fraction is removed by multiplying it with 1 for those
+        // rows and 0 otherwise; v - (v - (int32_t)v) is exact. Decoded values
+        // are at most 16 bits scaled, so they fit an int32_t.
+        v -= (v - (int32_t)v) * isWholeUnitScale(r.scale);
+        // -DBL_MAX as minimum leaves the value unchanged
+        values[i] = qMax(v, r.minimum);
+    }
+}
+
+#endif // TSMPPT_REGISTERS_H
@@ -0,0 +1,224 @@
+#include <QList>
+#include <velib/qt/v_busitems.h>
+#include "v_bus_item_store.h"
+
+Q_DECLARE_METATYPE(QList<int>)
+
+static const char *Interface = "com.victronenergy.BusItem";
+
+static const QString ValueKey("Value");
+static const QString TextKey("Text");
+
+// GetText returns a string for items, and a map (variant) for nodes
+static const char *InterfaceXml =
+	"  <interface name=\"com.victronenergy.BusItem\">\n"
+	"    <method name=\"GetValue\">\n"
+	"      <arg direction=\"out\" type=\"v\" name=\"value\"/>\n"
+	"    </method>\n"
+	"    <method name=\"GetText\">\n"
+	"      <arg direction=\"out\" type=\"%1\" name=\"value\"/>\n"
+	"    </method>\n"
+	"    <method name=\"SetValue\">\n"
+	"      <arg direction=\"in\" type=\"v\" name=\"value\"/>\n"
+	"      <arg direction=\"out\" type=\"i\" name=\"retval\"/>\n"
+	"    </method>\n"
+	"    <signal name=\"PropertiesChanged\">\n"
+	"      <arg type=\"a{sv}\" name=\"changes\"/>\n"
+	"    </signal>\n"
+	"    <signal name=\"ItemsChanged\">\n"
+	"      <arg type=\"a{sa{sv}}\" name=\"changes\"/>\n"
+	"    </signal>\n"
+	"  </interface>\n";
+
+VBusItemStore::VBusItemStore(QObject *parent) :
+	QObject(parent),
+	mRootValuesValid(false),
+	mRootTextsValid(false)
+{
+	mNodes.insert("/");
+}
+
+VBusItemStore::~VBusItemStore()
+{
+}
+
+int VBusItemStore::addItem(const QString &path, const QVariant &value,
+						   const QString &unit, int precision)
+{
+	if (!path.startsWith('/') || mPaths.contains(path) || mNodes.contains(path))
+		return -1;
+	QHash<QString, QString>::iterator u = mUnits.find(unit);
+	if (u == mUnits.end())
+		u = mUnits.insert(unit, unit);
+
+	Item item;
+	item.path = path;
+	item.rootKey = path.mid(1);
+	item.unit = u.value();
+	item.precision = precision;
+	storeValue(item, value);
+	int id = mItems.size();
+	mItems.append(item);
+	mPaths.insert(path, id);
+	for (int i = path.indexOf('/', 1); i != -1; i = path.indexOf('/', i + 1))
+		mNodes.insert(path.left(i));
+
+	mRootValuesValid = false;
+	mRootTextsValid = false;
+	mRootValues.clear();
+	mRootTexts.clear();
+	return id;
+}
+
+int VBusItemStore::itemCount() const
+{
+	return mItems.size();
+}
+
+int VBusItemStore::findItem(const QString &path) const
+{
+	return mPaths.value(path, -1);
+}
+
+bool VBusItemStore::isNode(const QString &path) const
+{
+	return mNodes.contains(path);
+}
+
+QString VBusItemStore::path(int id) const
+{
+	return mItems[id].path;
+}
+
+QVariant VBusItemStore::value(int id) const
+{
+	return mItems[id].value;
+}
+
+bool VBusItemStore::isNumber(int id) const
+{
+	return mItems[id].isNumber;
+}
+
+double VBusItemStore::number(int id) const
+{
+	return mItems[id].number;
+}
+
+QString VBusItemStore::text(int id)
+{
+	Item &item = mItems[id];
+	if (item.textValid)
+		return item.text;
+	if (item.precision >= 0 && item.isNumber)
+		item.text.setNum(item.number, 'f', item.precision);
+	else
+		item.text = item.value.toString();
+	if (!item.text.isEmpty())
+		item.text += item.unit;
+	item.textValid = true;
+	return item.text;
+}
+
+void VBusItemStore::setValue(int id, const QVariant &value)
+{
+	Item &item = mItems[id];
+	if (value.type() == QVariant::Double) {
+		if (item.isNumber && value.toDouble() == item.number)
+			return;
+	} else if (!item.isNumber && item.value == value) {
+		return;
+	}
+	storeValue(item, value);
+	updateRootCache(id);
+	emit valueChanged(id);
+
+	if (!VBusItems::itemSignalsEnabled())
+		return;
+	// The map and its keys are reused, so once the map has been allocated
+	// only the values are replaced.
+	mChanges[ValueKey] = mItems[id].value;
+	mChanges[TextKey] = text(id);
+	sendPropertiesChanged(id, mChanges);
+}
+
+void VBusItemStore::publishItemsChanged(const VBusItemChanges &changes)
+{
+	if (changes.isEmpty())
+		return;
+	sendItemsChanged(changes);
+}
+
+const char *VBusItemStore::interfaceName()
+{
+	return Interface;
+}
+
+QStringList VBusItemStore::childNames(const QString &path) const
+{
+	QString prefix = path == "/" ? path : path + "/";
+	QStringList children;
+	foreach (const Item &item, mItems) {
+		if (!item.path.startsWith(prefix))
+			continue;
+		QString name = item.path.mid(prefix.size()).section('/', 0, 0);
+		if (!children.contains(name))
+			children.append(name);
+	}
+	return children;
+}
+
+QString VBusItemStore::interfaceXml(const QString &path) const
+{
+	bool node = mNodes.contains(path);
+	if (!node && !mPaths.contains(path))
+		return QString();
+	return QString(InterfaceXml).arg(node ? "v" : "s");
+}
+
+void VBusItemStore::storeValue(Item &item, const QVariant &value)
+{
+	item.value = value.isValid() ? value : QVariant::fromValue(QList<int>());
+	item.isNumber = value.type() == QVariant::Double;
+	item.number = item.isNumber ? value.toDouble() : 0;
+	item.textValid = false;
+}
+
+QVariantMap VBusItemStore::nodeMap(const QString &path, bool useText)
+{
+	// The map of the root node is cached, other nodes are rarely requested.
+	bool isRoot = path == "/";
+	if (isRoot && useText && mRootTextsValid)
+		return mRootTexts;
+	if (isRoot && !useText && mRootValuesValid)
+		return mRootValues;
+	QString prefix = isRoot ? path : path + "/";
+	QVariantMap map;
+	for (int id = 0; id < mItems.size(); ++id) {
+		if (!mItems[id].path.startsWith(prefix))
+			continue;
+		QString key = mItems[id].path.mid(prefix.size());
+		if (useText)
+			map.insert(key, text(id));
+		else
+			map.insert(key, mItems[id].value);
+	}
+	if (isRoot && useText) {
+		mRootTexts = map;
+		mRootTextsValid = true;
+	} else if (isRoot) {
+		mRootValues = map;
+		mRootValuesValid = true;
+	}
+	return map;
+}
+
+void VBusItemStore::updateRootCache(int id)
+{
+	// The keys are already in the maps, so only the values are replaced.
+	const QString &key = mItems[id].rootKey;
+	if (mRootValuesValid)
+		mRootValues[key] = mItems[id].value;
+	if (mRootTextsValid)
+		mRootTexts[key] = text(id);
+}
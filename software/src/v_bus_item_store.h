@@ -0,0 +1,147 @@
+#ifndef V_BUS_ITEM_STORE_H
+#define V_BUS_ITEM_STORE_H
+
+#include <QHash>
+#include <QObject>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <QVariant>
+#include <QVector>
+#include "v_bus_node.h"
+
+/*!
+ * @brief Keeps all D-Bus items of a service in a single table.
+ * Instead of a `VBusItem` with its private object, adaptor and registered D-Bus
+ * object per path (plus a `VBusNode` per node), all items are rows in a table:
+ * path, typed value, unit, precision and the text, which is formatted on
+ * demand. A subclass puts the table on the D-Bus, with one handler for every
+ * path of the service. It must answer GetValue, GetText and SetValue for items
+ * and nodes like `VBusItem` and `VBusNode` do, and send the signals passed to
+ * `sendPropertiesChanged` and `sendItemsChanged`.
+ */
+class VBusItemStore : public QObject
+{
+	Q_OBJECT
+public:
+	explicit VBusItemStore(QObject *parent);
+
+	virtual ~VBusItemStore();
+
+	/*!
+	 * @brief Acquires the service name on the connection of the store.
+	 */
+	virtual bool registerService(const QString &name) = 0;
+
+	virtual bool unregisterService(const QString &name) = 0;
+
+	/*!
+	 * @brief Adds an item.
+	 * @return The ID of the item, used in the other functions, or -1 if the
+	 * path is already in use.
+	 */
+	int addItem(const QString &path, const QVariant &value,
+				const QString &unit = QString(), int precision = -1);
+
+	int itemCount() const;
+
+	/*!
+	 * @brief Returns the ID of the item at `path`, or -1.
+	 */
+	int findItem(const QString &path) const;
+
+	/*!
+	 * @brief Returns true if `path` is the root or has items below it.
+	 */
+	bool isNode(const QString &path) const;
+
+	QString path(int id) const;
+
+	QVariant value(int id) const;
+
+	/*!
+	 * @brief True if the value of the item is a double, available without
+	 * conversion through `number`.
+	 */
+	bool isNumber(int id) const;
+
+	double number(int id) const;
+
+	/*!
+	 * @brief The text of the item. It is formatted on first use after a
+	 * change.
+	 */
+	QString text(int id);
+
+	/*!
+	 * @brief Changes the value of an item. Emits `valueChanged` and, if
+	 * enabled by `VBusItems::setItemSignalsEnabled`, sends the
+	 * PropertiesChanged signal of the item.
+	 */
+	void setValue(int id, const QVariant &value);
+
+	/*!
+	 * @brief The map returned by GetValue (or GetText if `useText` is set)
+	 * of the node at `path`. Keys are relative to the node.
+	 */
+	QVariantMap nodeMap(const QString &path, bool useText);
+
+	/*!
+	 * @brief Names of the direct children (items and nodes) of a node.
+	 */
+	QStringList childNames(const QString &path) const;
+
+	/*!
+	 * @brief Introspection data of the interface at `path`, without the
+	 * enclosing node element.
+	 */
+	QString interfaceXml(const QString &path) const;
+
+	/*!
+	 * @brief Sends the ItemsChanged signal on the root path.
+	 */
+	void publishItemsChanged(const VBusItemChanges &changes);
+
+	static const char *interfaceName();
+
+signals:
+	/*!
+	 * @brief Emitted when the value of an item changes, through `setValue` or
+	 * a SetValue call on the D-Bus.
+	 */
+	void valueChanged(int id);
+
+protected:
+	virtual void sendPropertiesChanged(int id, const QVariantMap &changes) = 0;
+
+	virtual void sendItemsChanged(const VBusItemChanges &changes) = 0;
+
+private:
+	struct Item
+	{
+		QString path;
+		QString rootKey;    // Key in the maps of the root node
+		QVariant value;
+		double number;      // value, if it is a double
+		QString unit;       // Interned, shared by all items with this unit
+		QString text;
+		qint8 precision;
+		bool isNumber;
+		bool textValid;
+	};
+
+	void storeValue(Item &item, const QVariant &value);
+	void updateRootCache(int id);
+
+	QVector<Item> mItems;
+	QHash<QString, int> mPaths;
+	QSet<QString> mNodes;
+	QHash<QString, QString> mUnits;
+	QVariantMap mRootValues;
+	QVariantMap mRootTexts;
+	QVariantMap mChanges;   // Reused for PropertiesChanged
+	bool mRootValuesValid;
+	bool mRootTextsValid;
+};
+
+#endif // V_BUS_ITEM_STORE_H
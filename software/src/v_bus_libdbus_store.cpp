@@ -0,0 +1,526 @@
+#include <string.h>
+#include <dbus/dbus.h>
+#include <QList>
+#include <QSocketNotifier>
+#include <QsLog.h>
+#include <QStringList>
+#include <QTimer>
+#include <velib/qt/v_busitems.h>
+#include "v_bus_libdbus_store.h"
+
+Q_DECLARE_METATYPE(QList<int>)
+
+static const char *IntrospectHeader =
+	DBUS_INTROSPECT_1_0_XML_DOCTYPE_DECL_NODE
+	"<node>\n"
+	"  <interface name=\"org.freedesktop.DBus.Introspectable\">\n"
+	"    <method name=\"Introspect\">\n"
+	"      <arg direction=\"out\" type=\"s\" name=\"xml_data\"/>\n"
+	"    </method>\n"
+	"  </interface>\n";
+
+static void appendString(DBusMessageIter *iter, const QString &s)
+{
+	QByteArray utf8 = s.toUtf8();
+	const char *data = utf8.constData();
+	dbus_message_iter_append_basic(iter, DBUS_TYPE_STRING, &data);
+}
+
+static void appendBasicVariant(DBusMessageIter *iter, int type, const void *value)
+{
+	char signature[2] = { static_cast<char>(type), 0 };
+	DBusMessageIter variant;
+	dbus_message_iter_open_container(iter, DBUS_TYPE_VARIANT, signature, &variant);
+	dbus_message_iter_append_basic(&variant, type, value);
+	dbus_message_iter_close_container(iter, &variant);
+}
+
+static void appendNumber(DBusMessageIter *iter, double value)
+{
+	appendBasicVariant(iter, DBUS_TYPE_DOUBLE, &value);
+}
+
+static void appendVariant(DBusMessageIter *iter, const QVariant &value);
+
+// a{sv}
+static void appendMap(DBusMessageIter *iter, const QVariantMap &map)
+{
+	DBusMessageIter array;
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY, "{sv}", &array);
+	for (QVariantMap::const_iterator it = map.begin(); it != map.end(); ++it) {
+		DBusMessageIter entry;
+		dbus_message_iter_open_container(&array, DBUS_TYPE_DICT_ENTRY, 0, &entry);
+		appendString(&entry, it.key());
+		appendVariant(&entry, it.value());
+		dbus_message_iter_close_container(&array, &entry);
+	}
+	dbus_message_iter_close_container(iter, &array);
+}
+
+static void appendVariant(DBusMessageIter *iter, const QVariant &value)
+{
+	switch (value.type()) {
+	case QVariant::Double:
+		appendNumber(iter, value.toDouble());
+		return;
+	case QVariant::Int: {
+		dbus_int32_t v = value.toInt();
+		appendBasicVariant(iter, DBUS_TYPE_INT32, &v);
+		return;
+	}
+	case QVariant::UInt: {
+		dbus_uint32_t v = value.toUInt();
+		appendBasicVariant(iter, DBUS_TYPE_UINT32, &v);
+		return;
+	}
+	case QVariant::LongLong: {
+		dbus_int64_t v = value.toLongLong();
+		appendBasicVariant(iter, DBUS_TYPE_INT64, &v);
+		return;
+	}
+	case QVariant::ULongLong: {
+		dbus_uint64_t v = value.toULongLong();
+		appendBasicVariant(iter, DBUS_TYPE_UINT64, &v);
+		return;
+	}
+	case QVariant::Bool: {
+		dbus_bool_t v = value.toBool();
+		appendBasicVariant(iter, DBUS_TYPE_BOOLEAN, &v);
+		return;
+	}
+	case QVariant::Map: {
+		DBusMessageIter variant;
+		dbus_message_iter_open_container(iter, DBUS_TYPE_VARIANT, "a{sv}", &variant);
+		appendMap(&variant, value.toMap());
+		dbus_message_iter_close_container(iter, &variant);
+		return;
+	}
+	default:
+		break;
+	}
+	if (value.userType() == qMetaTypeId<QList<int> >()) {
+		// Invalid values are published as an empty array of integers
+		DBusMessageIter variant;
+		DBusMessageIter array;
+		dbus_message_iter_open_container(iter, DBUS_TYPE_VARIANT, "ai", &variant);
+		dbus_message_iter_open_container(&variant, DBUS_TYPE_ARRAY, "i", &array);
+		foreach (int i, value.value<QList<int> >()) {
+			dbus_int32_t v = i;
+			dbus_message_iter_append_basic(&array, DBUS_TYPE_INT32, &v);
+		}
+		dbus_message_iter_close_container(&variant, &array);
+		dbus_message_iter_close_container(iter, &variant);
+		return;
+	}
+	QByteArray utf8 = value.toString().toUtf8();
+	const char *data = utf8.constData();
+	appendBasicVariant(iter, DBUS_TYPE_STRING, &data);
+}
+
+static QVariant readVariant(DBusMessageIter *iter)
+{
+	DBusMessageIter variant;
+	dbus_message_iter_recurse(iter, &variant);
+	DBusBasicValue v;
+	switch (dbus_message_iter_get_arg_type(&variant)) {
+	case DBUS_TYPE_DOUBLE:
+		dbus_message_iter_get_basic(&variant, &v);
+		return QVariant(v.dbl);
+	case DBUS_TYPE_INT32:
+		dbus_message_iter_get_basic(&variant, &v);
+		return QVariant(static_cast<int>(v.i32));
+	case DBUS_TYPE_UINT32:
+		dbus_message_iter_get_basic(&variant, &v);
+		return QVariant(static_cast<uint>(v.u32));
+	case DBUS_TYPE_INT16:
+		dbus_message_iter_get_basic(&variant, &v);
+		return QVariant(static_cast<int>(v.i16));
+	case DBUS_TYPE_UINT16:
+		dbus_message_iter_get_basic(&variant, &v);
+		return QVariant(static_cast<int>(v.u16));
+	case DBUS_TYPE_BYTE:
+		dbus_message_iter_get_basic(&variant, &v);
+		return QVariant(static_cast<int>(v.byt));
+	case DBUS_TYPE_INT64:
+		dbus_message_iter_get_basic(&variant, &v);
+		return QVariant(static_cast<qlonglong>(v.i64));
+	case DBUS_TYPE_UINT64:
+		dbus_message_iter_get_basic(&variant, &v);
+		return QVariant(static_cast<qulonglong>(v.u64));
+	case DBUS_TYPE_BOOLEAN:
+		dbus_message_iter_get_basic(&variant, &v);
+		return QVariant(v.bool_val != 0);
+	case DBUS_TYPE_STRING:
+		dbus_message_iter_get_basic(&variant, &v);
+		return QVariant(QString::fromUtf8(v.str));
+	default:
+		return QVariant();
+	}
+}
+
+struct VBusLibDBusStore::Callbacks
+{
+	static dbus_bool_t addWatch(DBusWatch *watch, void *data)
+	{
+		return static_cast<VBusLibDBusStore *>(data)->addWatch(watch);
+	}
+
+	static void removeWatch(DBusWatch *watch, void *data)
+	{
+		static_cast<VBusLibDBusStore *>(data)->removeWatch(watch);
+	}
+
+	static void toggleWatch(DBusWatch *watch, void *data)
+	{
+		static_cast<VBusLibDBusStore *>(data)->toggleWatch(watch);
+	}
+
+	static dbus_bool_t addTimeout(DBusTimeout *timeout, void *data)
+	{
+		return static_cast<VBusLibDBusStore *>(data)->addTimeout(timeout);
+	}
+
+	static void removeTimeout(DBusTimeout *timeout, void *data)
+	{
+		static_cast<VBusLibDBusStore *>(data)->removeTimeout(timeout);
+	}
+
+	static void toggleTimeout(DBusTimeout *timeout, void *data)
+	{
+		static_cast<VBusLibDBusStore *>(data)->toggleTimeout(timeout);
+	}
+
+	static void dispatchStatus(DBusConnection *, DBusDispatchStatus status, void *data)
+	{
+		// Dispatching from within this callback is not allowed
+		if (status == DBUS_DISPATCH_DATA_REMAINS)
+			QMetaObject::invokeMethod(static_cast<VBusLibDBusStore *>(data), "dispatch",
+									  Qt::QueuedConnection);
+	}
+
+	static DBusHandlerResult handleMessage(DBusConnection *, DBusMessage *message,
+										   void *data)
+	{
+		return static_cast<VBusLibDBusStore *>(data)->handleMessage(message) ?
+			DBUS_HANDLER_RESULT_HANDLED : DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+	}
+};
+
+VBusLibDBusStore::VBusLibDBusStore(QObject *parent) :
+	VBusItemStore(parent),
+	mConnection(0)
+{
+	DBusError error;
+	dbus_error_init(&error);
+	QString address = VBusItems::dbusAddress();
+	if (address.isEmpty()) {
+		DBusBusType type = VBusItems::connectionType() == QDBusConnection::SystemBus ?
+			DBUS_BUS_SYSTEM : DBUS_BUS_SESSION;
+		mConnection = dbus_bus_get_private(type, &error);
+	} else {
+		mConnection = dbus_connection_open_private(address.toUtf8().constData(), &error);
+		if (mConnection != 0 && !dbus_bus_register(mConnection, &error)) {
+			dbus_connection_close(mConnection);
+			dbus_connection_unref(mConnection);
+			mConnection = 0;
+		}
+	}
+	if (mConnection == 0) {
+		QLOG_ERROR() << "VBusLibDBusStore: could not connect:" << error.message;
+		dbus_error_free(&error);
+		return;
+	}
+	dbus_connection_set_exit_on_disconnect(mConnection, FALSE);
+	dbus_connection_set_watch_functions(mConnection, Callbacks::addWatch,
+										Callbacks::removeWatch,
+										Callbacks::toggleWatch, this, 0);
+	dbus_connection_set_timeout_functions(mConnection, Callbacks::addTimeout,
+										  Callbacks::removeTimeout,
+										  Callbacks::toggleTimeout, this, 0);
+	dbus_connection_set_dispatch_status_function(mConnection, Callbacks::dispatchStatus,
+												 this, 0);
+	static const DBusObjectPathVTable vtable = {
+		0, Callbacks::handleMessage, 0, 0, 0, 0
+	};
+	if (!dbus_connection_register_fallback(mConnection, "/", &vtable, this))
+		QLOG_ERROR() << "VBusLibDBusStore: could not register the root object";
+	// Messages may have arrived while registering on the bus
+	QMetaObject::invokeMethod(this, "dispatch", Qt::QueuedConnection);
+}
+
+VBusLibDBusStore::~VBusLibDBusStore()
+{
+	if (mConnection == 0)
+		return;
+	dbus_connection_unregister_object_path(mConnection, "/");
+	dbus_connection_close(mConnection);
+	dbus_connection_unref(mConnection);
+}
+
+bool VBusLibDBusStore::isConnected() const
+{
+	return mConnection != 0 && dbus_connection_get_is_connected(mConnection);
+}
+
+bool VBusLibDBusStore::registerService(const QString &name)
+{
+	if (mConnection == 0)
+		return false;
+	DBusError error;
+	dbus_error_init(&error);
+	int result = dbus_bus_request_name(mConnection, name.toUtf8().constData(),
+									   DBUS_NAME_FLAG_DO_NOT_QUEUE, &error);
+	if (dbus_error_is_set(&error)) {
+		QLOG_ERROR() << "VBusLibDBusStore: RequestName failed:" << error.message;
+		dbus_error_free(&error);
+		return false;
+	}
+	return result == DBUS_REQUEST_NAME_REPLY_PRIMARY_OWNER ||
+		result == DBUS_REQUEST_NAME_REPLY_ALREADY_OWNER;
+}
+
+bool VBusLibDBusStore::unregisterService(const QString &name)
+{
+	if (mConnection == 0)
+		return false;
+	DBusError error;
+	dbus_error_init(&error);
+	int result = dbus_bus_release_name(mConnection, name.toUtf8().constData(), &error);
+	if (dbus_error_is_set(&error)) {
+		dbus_error_free(&error);
+		return false;
+	}
+	return result == DBUS_RELEASE_NAME_REPLY_RELEASED;
+}
+
+void VBusLibDBusStore::sendPropertiesChanged(int id, const QVariantMap &changes)
+{
+	if (mConnection == 0)
+		return;
+	QByteArray p = path(id).toUtf8();
+	DBusMessage *signal = dbus_message_new_signal(p.constData(), interfaceName(),
+												  "PropertiesChanged");
+	DBusMessageIter iter;
+	dbus_message_iter_init_append(signal, &iter);
+	appendMap(&iter, changes);
+	send(signal);
+}
+
+void VBusLibDBusStore::sendItemsChanged(const VBusItemChanges &changes)
+{
+	if (mConnection == 0)
+		return;
+	DBusMessage *signal = dbus_message_new_signal("/", interfaceName(), "ItemsChanged");
+	DBusMessageIter iter;
+	DBusMessageIter array;
+	dbus_message_iter_init_append(signal, &iter);
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, "{sa{sv}}", &array);
+	for (VBusItemChanges::const_iterator it = changes.begin(); it != changes.end(); ++it) {
+		DBusMessageIter entry;
+		dbus_message_iter_open_container(&array, DBUS_TYPE_DICT_ENTRY, 0, &entry);
+		appendString(&entry, it.key());
+		appendMap(&entry, it.value());
+		dbus_message_iter_close_container(&array, &entry);
+	}
+	dbus_message_iter_close_container(&iter, &array);
+	send(signal);
+}
+
+void VBusLibDBusStore::onSocketActivated(int)
+{
+	QSocketNotifier *notifier = static_cast<QSocketNotifier *>(sender());
+	DBusWatch *watch = mWatches.value(notifier);
+	if (watch == 0)
+		return;
+	dbus_watch_handle(watch, notifier->type() == QSocketNotifier::Read ?
+					  DBUS_WATCH_READABLE : DBUS_WATCH_WRITABLE);
+	dispatch();
+}
+
+void VBusLibDBusStore::onTimeout()
+{
+	DBusTimeout *timeout = mTimeouts.value(static_cast<QTimer *>(sender()));
+	if (timeout != 0)
+		dbus_timeout_handle(timeout);
+}
+
+void VBusLibDBusStore::dispatch()
+{
+	if (mConnection == 0)
+		return;
+	while (dbus_connection_dispatch(mConnection) == DBUS_DISPATCH_DATA_REMAINS)
+		;
+}
+
+bool VBusLibDBusStore::handleMessage(DBusMessage *message)
+{
+	if (dbus_message_get_type(message) != DBUS_MESSAGE_TYPE_METHOD_CALL)
+		return false;
+	QString path = QString::fromUtf8(dbus_message_get_path(message));
+	int id = findItem(path);
+	if (id == -1 && !isNode(path))
+		return false;
+	const char *interface = dbus_message_get_interface(message);
+	DBusMessage *reply = 0;
+	if (dbus_message_is_method_call(message, DBUS_INTERFACE_INTROSPECTABLE, "Introspect")) {
+		reply = dbus_message_new_method_return(message);
+		DBusMessageIter iter;
+		dbus_message_iter_init_append(reply, &iter);
+		appendString(&iter, introspect(path));
+	} else if (interface == 0 || strcmp(interface, interfaceName()) == 0) {
+		reply = createReply(message, path, id);
+	} else {
+		return false;
+	}
+	if (reply == 0) {
+		reply = dbus_message_new_error_printf(message, DBUS_ERROR_UNKNOWN_METHOD,
+											  "Unknown method %s",
+											  dbus_message_get_member(message));
+	}
+	send(reply);
+	return true;
+}
+
+DBusMessage *VBusLibDBusStore::createReply(DBusMessage *message, const QString &path,
+										   int id)
+{
+	const char *member = dbus_message_get_member(message);
+	DBusMessage *reply = 0;
+	DBusMessageIter iter;
+	if (strcmp(member, "GetValue") == 0) {
+		reply = dbus_message_new_method_return(message);
+		dbus_message_iter_init_append(reply, &iter);
+		if (id == -1)
+			appendVariant(&iter, QVariant(nodeMap(path, false)));
+		else if (isNumber(id))
+			appendNumber(&iter, number(id));
+		else
+			appendVariant(&iter, value(id));
+	} else if (strcmp(member, "GetText") == 0) {
+		reply = dbus_message_new_method_return(message);
+		dbus_message_iter_init_append(reply, &iter);
+		if (id == -1)
+			appendVariant(&iter, QVariant(nodeMap(path, true)));
+		else
+			appendString(&iter, text(id));
+	} else if (strcmp(member, "SetValue") == 0 && id != -1) {
+		QVariant v;
+		if (dbus_message_iter_init(message, &iter) &&
+			dbus_message_iter_get_arg_type(&iter) == DBUS_TYPE_VARIANT)
+			v = readVariant(&iter);
+		if (!v.isValid()) {
+			return dbus_message_new_error(message, DBUS_ERROR_INVALID_ARGS,
+										  "Unsupported value type");
+		}
+		setValue(id, v);
+		reply = dbus_message_new_method_return(message);
+		dbus_int32_t result = 0;
+		dbus_message_append_args(reply, DBUS_TYPE_INT32, &result, DBUS_TYPE_INVALID);
+	}
+	return reply;
+}
+
+QString VBusLibDBusStore::introspect(const QString &path) const
+{
+	QString xml = IntrospectHeader;
+	xml += interfaceXml(path);
+	if (isNode(path)) {
+		foreach (const QString &name, childNames(path))
+			xml += "  <node name=\"" + name + "\"/>\n";
+	}
+	xml += "</node>\n";
+	return xml;
+}
+
+void VBusLibDBusStore::send(DBusMessage *message)
+{
+	if (message == 0)
+		return;
+	// Queued, the write watch is enabled until the message has been sent.
+	dbus_connection_send(mConnection, message, 0);
+	dbus_message_unref(message);
+}
+
+bool VBusLibDBusStore::addWatch(DBusWatch *watch)
+{
+	int fd = dbus_watch_get_unix_fd(watch);
+	unsigned int flags = dbus_watch_get_flags(watch);
+	bool enabled = dbus_watch_get_enabled(watch);
+	if (flags & DBUS_WATCH_READABLE) {
+		QSocketNotifier *notifier = new QSocketNotifier(fd, QSocketNotifier::Read, this);
+		notifier->setEnabled(enabled);
+		connect(notifier, SIGNAL(activated(int)), this, SLOT(onSocketActivated(int)));
+		mWatches.insert(notifier, watch);
+	}
+	if (flags & DBUS_WATCH_WRITABLE) {
+		QSocketNotifier *notifier = new QSocketNotifier(fd, QSocketNotifier::Write, this);
+		notifier->setEnabled(enabled);
+		connect(notifier, SIGNAL(activated(int)), this, SLOT(onSocketActivated(int)));
+		mWatches.insert(notifier, watch);
+	}
+	return true;
+}
+
+void VBusLibDBusStore::removeWatch(DBusWatch *watch)
+{
+	QHash<QSocketNotifier *, DBusWatch *>::iterator it = mWatches.begin();
+	while (it != mWatches.end()) {
+		if (it.value() == watch) {
+			// May be called from onSocketActivated of this notifier
+			it.key()->setEnabled(false);
+			it.key()->deleteLater();
+			it = mWatches.erase(it);
+		} else {
+			++it;
+		}
+	}
+}
+
+void VBusLibDBusStore::toggleWatch(DBusWatch *watch)
+{
+	bool enabled = dbus_watch_get_enabled(watch);
+	for (QHash<QSocketNotifier *, DBusWatch *>::iterator it = mWatches.begin();
+		 it != mWatches.end(); ++it) {
+		if (it.value() == watch)
+			it.key()->setEnabled(enabled);
+	}
+}
+
+bool VBusLibDBusStore::addTimeout(DBusTimeout *timeout)
+{
+	QTimer *timer = new QTimer(this);
+	timer->setInterval(dbus_timeout_get_interval(timeout));
+	connect(timer, SIGNAL(timeout()), this, SLOT(onTimeout()));
+	mTimeouts.insert(timer, timeout);
+	if (dbus_timeout_get_enabled(timeout))
+		timer->start();
+	return true;
+}
+
+void VBusLibDBusStore::removeTimeout(DBusTimeout *timeout)
+{
+	QHash<QTimer *, DBusTimeout *>::iterator it = mTimeouts.begin();
+	while (it != mTimeouts.end()) {
+		if (it.value() == timeout) {
+			it.key()->stop();
+			it.key()->deleteLater();
+			it = mTimeouts.erase(it);
+		} else {
+			++it;
+		}
+	}
+}
+
+void VBusLibDBusStore::toggleTimeout(DBusTimeout *timeout)
+{
+	for (QHash<QTimer *, DBusTimeout *>::iterator it = mTimeouts.begin();
+		 it != mTimeouts.end(); ++it) {
+		if (it.value() != timeout)
+			continue;
+		it.key()->setInterval(dbus_timeout_get_interval(timeout));
+		if (dbus_timeout_get_enabled(timeout))
+			it.key()->start();
+		else
+			it.key()->stop();
+	}
+}
@@ -0,0 +1,71 @@
+#ifndef V_BUS_LIBDBUS_STORE_H
+#define V_BUS_LIBDBUS_STORE_H
+
+#include <QHash>
+#include "v_bus_item_store.h"
+
+struct DBusConnection;
+struct DBusMessage;
+struct DBusTimeout;
+struct DBusWatch;
+class QSocketNotifier;
+class QTimer;
+
+/*!
+ * @brief Item store on a private libdbus connection.
+ * Method calls are handled by a libdbus fallback handler registered at "/",
+ * and replies and signals are marshalled directly from the values in the
+ * table, without the QVariant to QDBusArgument conversion of QtDBus. The
+ * connection is opened to the bus set with `VBusItems::setDBusAddress`, and
+ * its watches and timeouts run on the Qt event loop.
+ * Because the service name is owned by this connection, it must be acquired
+ * through `registerService` of the store.
+ */
+class VBusLibDBusStore : public VBusItemStore
+{
+	Q_OBJECT
+public:
+	explicit VBusLibDBusStore(QObject *parent);
+
+	virtual ~VBusLibDBusStore();
+
+	bool isConnected() const;
+
+	virtual bool registerService(const QString &name);
+
+	virtual bool unregisterService(const QString &name);
+
+protected:
+	virtual void sendPropertiesChanged(int id, const QVariantMap &changes);
+
+	virtual void sendItemsChanged(const VBusItemChanges &changes);
+
+private slots:
+	void onSocketActivated(int socket);
+
+	void onTimeout();
+
+	void dispatch();
+
+private:
+	struct Callbacks;
+	friend struct Callbacks;
+
+	bool handleMessage(DBusMessage *message);
+	DBusMessage *createReply(DBusMessage *message, const QString &path, int id);
+	QString introspect(const QString &path) const;
+	void send(DBusMessage *message);
+
+	bool addWatch(DBusWatch *watch);
+	void removeWatch(DBusWatch *watch);
+	void toggleWatch(DBusWatch *watch);
+	bool addTimeout(DBusTimeout *timeout);
+	void removeTimeout(DBusTimeout *timeout);
+	void toggleTimeout(DBusTimeout *timeout);
+
+	DBusConnection *mConnection;
+	QHash<QSocketNotifier *, DBusWatch *> mWatches;
+	QHash<QTimer *, DBusTimeout *> mTimeouts;
+};
+
+#endif // V_BUS_LIBDBUS_STORE_H
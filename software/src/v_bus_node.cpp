@@ -1,6 +1,8 @@
+#include <QDBusMetaType>
 #include <QList>
 #include <velib/qt/v_busitem.h>
 #include "v_bus_node.h"
+#include "v_bus_path_index.h"
 
 Q_DECLARE_METATYPE(QList<int>)
 
@@ -16,176 +18,233 @@ static QString combine(const QString &lhs, const QString &rhs)
 VBusNode::VBusNode(QDBusConnection &connection, const QString &path,
 				   QObject *parent) :
 	QDBusAbstractAdaptor(new QObject(parent)),
-	mConnection(connection)
+	mIndex(new VBusPathIndex(path, this)),
+	mEntry(0),
+	mConnection(connection),
+	mValueCacheValid(false),
+	mTextCacheValid(false)
+{
+	static bool metaTypesRegistered = false;
+	if (!metaTypesRegistered) {
+		qDBusRegisterMetaType<VBusItemChanges>();
+		metaTypesRegistered = true;
+	}
+	registerObject(path);
+}
+
+VBusNode::VBusNode(VBusNode *parentNode, const QString &name) :
+	QDBusAbstractAdaptor(new QObject(parentNode->parent())),
+	mIndex(parentNode->mIndex),
+	mEntry(mIndex->addEntry(parentNode->mEntry, name, 0, this)),
+	mConnection(parentNode->mConnection),
+	mValueCacheValid(false),
+	mTextCacheValid(false)
+{
+	registerObject(mIndex->entry(mEntry).path);
+}
+
+VBusNode::~VBusNode()
+{
+	// Entries below this node are removed as well. If this node was removed
+	// together with an ancestor, mEntry may already have been reused.
+	if (mIndex->findNode(this) == mEntry)
+		mIndex->removeEntry(mEntry);
+}
+
+void VBusNode::registerObject(const QString &path)
 {
 	// We need some trickery to get the adaptor running. A QDBusAbstractAdaptor
 	// consideres its parent to be the data source. It is the responsibility
 	// of the subclass (this class) to retrieve the data from that class.
 	// This class does not do that, but the QT DBus framework still expects a
 	// unique parent for each adapter.
-	connection.registerObject(path, this->parent());
+	mConnection.registerObject(path, this->parent());
+}
+
+int VBusNode::findEntry(const QString &path) const
+{
+	// Absolute paths take a single hash lookup. Below the root, walk the trie
+	// from this node instead of concatenating the path of the node.
+	if (mIndex->entry(mEntry).path == "/")
+		return mIndex->findPath(path);
+	return mIndex->findRelative(mEntry, path);
 }
 
 void VBusNode::addChild(const QString &path, VBusItem *item)
 {
-	addChild("/", path, item);
+	Q_ASSERT(path.startsWith('/'));
+	VBusNode *node = this;
+	int start = 1;
+	for (;;) {
+		int end = path.indexOf('/', start);
+		if (end == -1)
+			break;
+		QString name = path.mid(start, end - start);
+		int child = mIndex->findChild(node->mEntry, name);
+		if (child == -1) {
+			VBusNode *newNode = new VBusNode(node, name);
+			connect(newNode, SIGNAL(destroyed()), node, SLOT(onNodeDeleted()));
+			node = newNode;
+		} else {
+			node = mIndex->entry(child).node;
+			if (node == 0)
+				return; // An item exists at this path
+		}
+		start = end + 1;
+	}
+	if (mIndex->addEntry(node->mEntry, path.mid(start), item, 0) == -1)
+		return;
+	connect(item, SIGNAL(destroyed()), node, SLOT(onItemDeleted()));
+	connect(item, SIGNAL(valueChanged()), node, SLOT(onItemChanged()));
+	node->invalidateCache();
 }
 
 VBusItem *VBusNode::findItem(const QString &path) const
 {
-	int i = path.indexOf('/', 1);
-	QString id = path.mid(1, i - 1);
-	if (i == -1) {
-		QMap<QString, VBusItem *>::const_iterator it = mLeafs.find(id);
-		return it == mLeafs.end() ? 0 : it.value();
-	} else {
-		QMap<QString, VBusNode *>::const_iterator it = mNodes.find(id);
-		return it == mNodes.end() ? 0 : it.value()->findItem(path.mid(i));
-	}
+	int i = findEntry(path);
+	return i == -1 ? 0 : mIndex->entry(i).item;
 }
 
 VBusNode *VBusNode::findNode(const QString &path) const
 {
-	int i = path.indexOf('/', 1);
-	QString id = path.mid(1, i);
-	if (i == -1) {
-		QMap<QString, VBusNode *>::const_iterator it = mNodes.find(id);
-		return it == mNodes.end() ? 0 : it.value();
-	} else {
-		QMap<QString, VBusNode *>::const_iterator it = mNodes.find(id);
-		return it == mNodes.end() ? 0 : it.value()->findNode(path.mid(i));
-	}
+	int i = findEntry(path);
+	return i == -1 ? 0 : mIndex->entry(i).node;
 }
 
 QString VBusNode::findPath(const VBusItem *item) const
 {
-	for (QMap<QString, VBusItem *>::const_iterator it = mLeafs.begin();
-		 it != mLeafs.end();
-		 ++it) {
-		if (it.value() == item)
-			return "/" + it.key();
+	int i = mIndex->findItem(item);
+	if (i == -1)
+		return QString();
+	for (int p = mIndex->entry(i).parent; p != mEntry; p = mIndex->entry(p).parent) {
+		if (p == -1)
+			return QString(); // Not below this node
 	}
-	for (QMap<QString, VBusNode *>::const_iterator it = mNodes.begin();
-		 it != mNodes.end();
-		 ++it) {
-		QString p = it.value()->findPath(item);
-		if (!p.isEmpty())
-			return "/" + it.key() + p;
-	}
-	return QString();
+	return "/" + mIndex->relativePath(i, mEntry);
 }
 
 QString VBusNode::findPath(const VBusNode *item) const
 {
-	for (QMap<QString, VBusNode *>::const_iterator it = mNodes.begin();
-		 it != mNodes.end();
-		 ++it) {
-		if (it.value() == item)
-			return "/" + it.key();
-		QString p = it.value()->findPath(item);
-		if (!p.isEmpty())
-			return "/" + it.key() + p;
+	int i = mIndex->findNode(item);
+	if (i == -1 || i == mEntry)
+		return QString();
+	for (int p = mIndex->entry(i).parent; p != mEntry; p = mIndex->entry(p).parent) {
+		if (p == -1)
+			return QString(); // Not below this node
 	}
-	return QString();
+	return "/" + mIndex->relativePath(i, mEntry);
 }
 
 QStringList VBusNode::enumeratePaths() const
 {
-	QStringList result;
-	for (QMap<QString, VBusItem *>::const_iterator it = mLeafs.begin();
-		 it != mLeafs.end();
-		 ++it) {
-		result.append("/" + it.key());
-	}
-	for (QMap<QString, VBusNode *>::const_iterator it = mNodes.begin();
-		 it != mNodes.end();
-		 ++it) {
-		QStringList subList = it.value()->enumeratePaths();
-		foreach (QString s, subList) {
-			result.append("/" + it.key() + s);
-		}
-	}
-	return result;
+	return mIndex->enumeratePaths(mEntry);
+}
+
+void VBusNode::publishItemsChanged(const VBusItemChanges &changes)
+{
+	if (!changes.isEmpty())
+		emit ItemsChanged(changes);
 }
 
 QDBusVariant VBusNode::GetValue()
 {
-	QVariantMap result;
-	addToMap(QString(), result, false);
-	return QDBusVariant(result);
+	if (!mValueCacheValid) {
+		mValueCache.clear();
+		addToMap(mEntry, QString(), mValueCache, false);
+		mValueCacheValid = true;
+	}
+	return QDBusVariant(mValueCache);
 }
 
 QDBusVariant VBusNode::GetText()
 {
-	QVariantMap result;
-	addToMap(QString(), result, true);
-	return QDBusVariant(result);
+	if (!mTextCacheValid) {
+		mTextCache.clear();
+		addToMap(mEntry, QString(), mTextCache, true);
+		mTextCacheValid = true;
+	}
+	return QDBusVariant(mTextCache);
 }
 
-void VBusNode::onItemDeleted()
+void VBusNode::onItemChanged()
 {
-	for (;;) {
-		QString key = mLeafs.key(static_cast<VBusItem *>(sender()));
-		if (key.isEmpty())
-			break;
-		mLeafs.remove(key);
+	VBusItem *item = static_cast<VBusItem *>(sender());
+	int i = mIndex->findItem(item);
+	if (i == -1)
+		return;
+	QVariant value = item->getValue();
+	if (!value.isValid())
+		value = QVariant::fromValue(QList<int>());
+	QVariant text;
+	// Patch the entry in the caches up to the root. Keys are relative to the
+	// node owning the cache.
+	for (int p = mIndex->entry(i).parent; p != -1; p = mIndex->entry(p).parent) {
+		VBusNode *node = mIndex->entry(p).node;
+		if (!node->mValueCacheValid && !node->mTextCacheValid)
+			continue;
+		QString key = mIndex->relativePath(i, p);
+		if (node->mValueCacheValid)
+			node->mValueCache.insert(key, value);
+		if (node->mTextCacheValid) {
+			if (!text.isValid())
+				text = item->getText();
+			node->mTextCache.insert(key, text);
+		}
 	}
-	if (mLeafs.empty() && mNodes.empty())
+}
+
+void VBusNode::onItemDeleted()
+{
+	// The item is being destroyed, only its address may be used.
+	int i = mIndex->findItem(static_cast<VBusItem *>(sender()));
+	if (i != -1)
+		mIndex->removeEntry(i);
+	if (mIndex->findNode(this) != mEntry)
+		return; // Removed together with an ancestor
+	invalidateCache();
+	if (mIndex->entry(mEntry).children.isEmpty())
 		deleteLater();
 }
 
 void VBusNode::onNodeDeleted()
 {
-	for (;;) {
-		QString key = mNodes.key(static_cast<VBusNode *>(sender()));
-		if (key.isEmpty())
-			break;
-		mLeafs.remove(key);
-	}
-	if (mLeafs.empty() && mNodes.empty())
+	// The entry of the node has been removed by its destructor.
+	if (mIndex->findNode(this) != mEntry)
+		return; // Removed together with an ancestor
+	invalidateCache();
+	if (mIndex->entry(mEntry).children.isEmpty())
 		deleteLater();
 }
 
-void VBusNode::addToMap(const QString &prefix, QVariantMap &map, bool useText)
+void VBusNode::addToMap(int entry, const QString &prefix, QVariantMap &map,
+						bool useText) const
 {
-	for (QMap<QString, VBusItem *>::iterator it = mLeafs.begin();
-		 it != mLeafs.end();
-		 ++it) {
-		QVariant v;
-		if (useText) {
-			v = it.value()->getText();
+	foreach (int child, mIndex->entry(entry).children) {
+		const VBusPathIndex::Entry &e = mIndex->entry(child);
+		QString key = combine(prefix, mIndex->segmentName(e.segment));
+		if (e.item != 0) {
+			QVariant v;
+			if (useText) {
+				v = e.item->getText();
+			} else {
+				v = e.item->getValue();
+				if (!v.isValid())
+					v = QVariant::fromValue(QList<int>());
+			}
+			map[key] = v;
 		} else {
-			v = it.value()->getValue();
-			if (!v.isValid())
-				v = QVariant::fromValue(QList<int>());
+			addToMap(child, key, map, useText);
 		}
-		map[combine(prefix, it.key())] = v;
-	}
-	for (QMap<QString, VBusNode *>::iterator it = mNodes.begin();
-		 it != mNodes.end();
-		 ++it) {
-		it.value()->addToMap(combine(prefix, it.key()), map, useText);
 	}
 }
 
-void VBusNode::addChild(const QString &nodePath, const QString &subPath,
-						VBusItem *item)
-{
-	Q_ASSERT(nodePath.startsWith('/'));
-	Q_ASSERT(subPath.startsWith('/'));
-	int i = subPath.indexOf('/', 1);
-	if (i == -1) {
-		connect(item, SIGNAL(destroyed()), this, SLOT(onItemDeleted()));
-		mLeafs.insert(subPath.mid(1), item);
-	} else {
-		QString id = subPath.mid(1, i - 1);
-		QString newNodePath = combine(nodePath, id);
-		QMap<QString, VBusNode *>::iterator it = mNodes.find(id);
-		if (it == mNodes.end()) {
-			VBusNode *node = new VBusNode(mConnection, newNodePath, parent());
-			it = mNodes.insert(id, node);
-		}
-		it.value()->addChild(newNodePath, subPath.mid(i), item);
+void VBusNode::invalidateCache()
+{
+	for (int p = mEntry; p != -1; p = mIndex->entry(p).parent) {
+		VBusNode *node = mIndex->entry(p).node;
+		node->mValueCacheValid = false;
+		node->mTextCacheValid = false;
+		node->mValueCache.clear();
+		node->mTextCache.clear();
 	}
-	// emit PropertiesChanged(createMap());
 }
@@ -5,8 +5,18 @@
 #include <QDBusVariant>
 #include <QDBusConnection>
 #include <QMap>
+#include <QMetaType>
+#include <QSharedPointer>
 
 class VBusItem;
+class VBusPathIndex;
+
+/*!
+ * @brief Changed properties (`Value` and `Text`) per item path, as sent in
+ * the `ItemsChanged` signal (D-Bus signature a{sa{sv}}).
+ */
+typedef QMap<QString, QVariantMap> VBusItemChanges;
+Q_DECLARE_METATYPE(VBusItemChanges)
 
 /*!
  * @brief A D-Bus item that creates a map of its substructure when its
@@ -16,6 +26,13 @@ class VBusItem;
  * function. The root object will create additional `VbusNode` objects for all
  * nodes it the D-Bus structure. The GetValue function of each node will return
  * a map with all paths and value of its substructure.
+ * The maps returned by GetValue and GetText are cached. When an item changes,
+ * the entry of the item is updated in the caches of all nodes between the item
+ * and the root, so the next call just returns a (shared) copy of the cache.
+ * Adding or removing items invalidates the caches along the path.
+ * All nodes of a tree share a `VBusPathIndex`. The root finds items and nodes
+ * by their full path, and any node finds the path of an item, with a single
+ * hash lookup; other nodes resolve relative paths through the trie.
  * @note A `VBusNode` will delete itself (by calling `deleteLater` when all its
  * children (`VBusNode`s and `VBusItem`s are deleted). If you delete `VBusItem`s
  * dynamically, use a `QPointer` to store the pointer to the root node and check
@@ -28,6 +45,8 @@ class VBusNode : public QDBusAbstractAdaptor
 public:
 	VBusNode(QDBusConnection &connection, const QString &path, QObject *parent);
 
+	~VBusNode();
+
 	/*!
 	 * @brief A a `VBusItem` to the node structure. All nodes between this
 	 * node and the item will be automatically created whenever necessary.
@@ -68,6 +87,14 @@ public:
 	 */
 	QStringList enumeratePaths() const;
 
+	/*!
+	 * @brief Sends the `ItemsChanged` signal with the changes of several
+	 * items at once. Use this on the root node, so subscribers receive one
+	 * message instead of a `PropertiesChanged` signal per item.
+	 * @param changes Map from absolute item path to changed properties.
+	 */
+	void publishItemsChanged(const VBusItemChanges &changes);
+
 public slots:
 	QDBusVariant GetValue();
 
@@ -76,20 +103,34 @@ public slots:
 signals:
 	void PropertiesChanged(const QVariantMap &changes);
 
+	void ItemsChanged(const VBusItemChanges &changes);
+
 private slots:
+	void onItemChanged();
+
 	void onItemDeleted();
 
 	void onNodeDeleted();
 
 private:
-	void addToMap(const QString &prefix, QVariantMap &map, bool useText);
+	VBusNode(VBusNode *parentNode, const QString &name);
+
+	void registerObject(const QString &path);
+
+	int findEntry(const QString &path) const;
+
+	void addToMap(int entry, const QString &prefix, QVariantMap &map,
+				  bool useText) const;
 
-	void addChild(const QString &nodePath, const QString &subPath,
-				  VBusItem *item);
+	void invalidateCache();
 
-	QMap<QString, VBusItem *> mLeafs;
-	QMap<QString, VBusNode *> mNodes;
+	QSharedPointer<VBusPathIndex> mIndex;
+	int mEntry; // This node in mIndex
 	QDBusConnection mConnection;
+	QVariantMap mValueCache;
+	QVariantMap mTextCache;
+	bool mValueCacheValid;
+	bool mTextCacheValid;
 };
 
 #endif // V_BUS_NODE_H
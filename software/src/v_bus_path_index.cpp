@@ -0,0 +1,197 @@
+#include "v_bus_path_index.h"
+
+// FNV-1a over the UTF-16 code units. Qt 4.8 has no qHash for QStringRef, and
+// segments are looked up by reference to avoid copying them out of a path.
+static uint segmentHash(const QStringRef &name)
+{
+	uint hash = 2166136261u;
+	const QChar *c = name.unicode();
+	for (int i = 0; i < name.size(); ++i) {
+		hash ^= c[i].unicode();
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+VBusPathIndex::VBusPathIndex(const QString &rootPath, VBusNode *rootNode)
+{
+	Entry root;
+	root.segment = -1;
+	root.parent = -1;
+	root.path = rootPath;
+	root.item = 0;
+	root.node = rootNode;
+	mEntries.append(root);
+	mPaths.insert(rootPath, 0);
+	mNodes.insert(rootNode, 0);
+}
+
+int VBusPathIndex::root() const
+{
+	return 0;
+}
+
+const VBusPathIndex::Entry &VBusPathIndex::entry(int index) const
+{
+	return mEntries[index];
+}
+
+const QString &VBusPathIndex::segmentName(int segment) const
+{
+	return mSegments[segment];
+}
+
+int VBusPathIndex::addEntry(int parent, const QString &name, VBusItem *item,
+							VBusNode *node)
+{
+	int segment = internSegment(name);
+	ChildKey key(parent, segment);
+	if (mChildren.contains(key))
+		return -1;
+
+	int index;
+	if (mFreeEntries.isEmpty()) {
+		index = mEntries.size();
+		mEntries.append(Entry());
+	} else {
+		index = mFreeEntries.last();
+		mFreeEntries.pop_back();
+	}
+	Entry &e = mEntries[index];
+	e.segment = segment;
+	e.parent = parent;
+	e.path = mEntries[parent].path;
+	if (!e.path.endsWith('/'))
+		e.path.append('/');
+	e.path.append(name);
+	e.item = item;
+	e.node = node;
+	e.children.clear();
+
+	mEntries[parent].children.append(index);
+	mChildren.insert(key, index);
+	mPaths.insert(e.path, index);
+	if (item != 0)
+		mItems.insert(item, index);
+	if (node != 0)
+		mNodes.insert(node, index);
+	return index;
+}
+
+void VBusPathIndex::removeEntry(int index)
+{
+	if (index <= 0 || index >= mEntries.size() || mEntries[index].segment == -1)
+		return;
+	// Copy, because the children remove themselves from the list.
+	QVector<int> children = mEntries[index].children;
+	foreach (int child, children)
+		removeEntry(child);
+
+	Entry &e = mEntries[index];
+	QVector<int> &siblings = mEntries[e.parent].children;
+	siblings.remove(siblings.indexOf(index));
+	mChildren.remove(ChildKey(e.parent, e.segment));
+	mPaths.remove(e.path);
+	if (e.item != 0)
+		mItems.remove(e.item);
+	if (e.node != 0)
+		mNodes.remove(e.node);
+	e.segment = -1;
+	e.parent = -1;
+	e.path.clear();
+	e.item = 0;
+	e.node = 0;
+	mFreeEntries.append(index);
+}
+
+int VBusPathIndex::findChild(int parent, const QString &name) const
+{
+	return findChild(parent, QStringRef(&name));
+}
+
+int VBusPathIndex::findChild(int parent, const QStringRef &name) const
+{
+	int segment = findSegment(name);
+	if (segment == -1)
+		return -1;
+	return mChildren.value(ChildKey(parent, segment), -1);
+}
+
+int VBusPathIndex::findPath(const QString &path) const
+{
+	return mPaths.value(path, -1);
+}
+
+int VBusPathIndex::findRelative(int ancestor, const QString &path) const
+{
+	int index = ancestor;
+	int start = path.startsWith('/') ? 1 : 0;
+	while (index != -1 && start < path.size()) {
+		int end = path.indexOf('/', start);
+		if (end == -1)
+			end = path.size();
+		index = findChild(index, QStringRef(&path, start, end - start));
+		start = end + 1;
+	}
+	return index;
+}
+
+int VBusPathIndex::findItem(const VBusItem *item) const
+{
+	return mItems.value(item, -1);
+}
+
+int VBusPathIndex::findNode(const VBusNode *node) const
+{
+	return mNodes.value(node, -1);
+}
+
+QString VBusPathIndex::relativePath(int index, int ancestor) const
+{
+	const QString &path = mEntries[index].path;
+	if (ancestor < 0)
+		return path;
+	const QString &prefix = mEntries[ancestor].path;
+	return path.mid(prefix.endsWith('/') ? prefix.size() : prefix.size() + 1);
+}
+
+QStringList VBusPathIndex::enumeratePaths(int index) const
+{
+	QStringList paths;
+	const QString &prefix = mEntries[index].path;
+	enumeratePaths(index, prefix.endsWith('/') ? prefix.size() - 1 : prefix.size(), paths);
+	return paths;
+}
+
+int VBusPathIndex::internSegment(const QString &name)
+{
+	QStringRef ref(&name);
+	int id = findSegment(ref);
+	if (id != -1)
+		return id;
+	id = mSegments.size();
+	mSegments.append(name);
+	mSegmentIds.insert(segmentHash(ref), id);
+	return id;
+}
+
+int VBusPathIndex::findSegment(const QStringRef &name) const
+{
+	uint hash = segmentHash(name);
+	QMultiHash<uint, int>::const_iterator it = mSegmentIds.constFind(hash);
+	for (; it != mSegmentIds.constEnd() && it.key() == hash; ++it) {
+		if (mSegments[it.value()] == name)
+			return it.value();
+	}
+	return -1;
+}
+
+void VBusPathIndex::enumeratePaths(int index, int prefixLength,
+								   QStringList &paths) const
+{
+	const Entry &e = mEntries[index];
+	if (e.item != 0)
+		paths.append(e.path.mid(prefixLength));
+	foreach (int child, e.children)
+		enumeratePaths(child, prefixLength, paths);
+}
@@ -0,0 +1,111 @@
+#ifndef V_BUS_PATH_INDEX_H
+#define V_BUS_PATH_INDEX_H
+
+#include <QHash>
+#include <QPair>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+class VBusItem;
+class VBusNode;
+
+/*!
+ * @brief Path index of a tree of `VBusNode`s and `VBusItem`s.
+ * The tree is stored as a flat trie: every node and item is an entry in a
+ * single array, and refers to its parent and children by their position in
+ * that array. Path segments are interned, so children are looked up by
+ * (parent, segment ID) instead of by string.
+ * Besides the trie, the index keeps a hash from full path to entry, and from
+ * item or node to entry. Looking up an item by its full path, or the path of an
+ * item, takes a single hash lookup and does not allocate memory. Neither does
+ * a relative lookup: segments are looked up in place, without copying them.
+ */
+class VBusPathIndex
+{
+public:
+	struct Entry
+	{
+		int segment;        // Interned name, -1 for the root and free entries
+		int parent;         // -1 for the root
+		QString path;       // Absolute path
+		VBusItem *item;     // Set for leafs
+		VBusNode *node;     // Set for nodes
+		QVector<int> children;
+	};
+
+	/*!
+	 * @brief Creates an index with a root entry for `rootNode` at `rootPath`.
+	 */
+	VBusPathIndex(const QString &rootPath, VBusNode *rootNode);
+
+	int root() const;
+
+	const Entry &entry(int index) const;
+
+	const QString &segmentName(int segment) const;
+
+	/*!
+	 * @brief Adds a child entry for an item or a node below `parent`.
+	 * @return The new entry, or -1 if `parent` already has a child called
+	 * `name`.
+	 */
+	int addEntry(int parent, const QString &name, VBusItem *item, VBusNode *node);
+
+	/*!
+	 * @brief Removes an entry and all entries below it.
+	 */
+	void removeEntry(int index);
+
+	/*!
+	 * @brief Returns the child of `parent` called `name`, or -1.
+	 */
+	int findChild(int parent, const QString &name) const;
+
+	/*!
+	 * @brief Returns the entry with the given absolute path, or -1.
+	 */
+	int findPath(const QString &path) const;
+
+	/*!
+	 * @brief Returns the entry at `path` (with leading slash) relative to
+	 * `ancestor`, or -1. The path is resolved segment by segment through the
+	 * trie, so no absolute path or segment string has to be built.
+	 */
+	int findRelative(int ancestor, const QString &path) const;
+
+	int findItem(const VBusItem *item) const;
+
+	int findNode(const VBusNode *node) const;
+
+	/*!
+	 * @brief Returns the path of `index` relative to its ancestor `ancestor`
+	 * (without leading slash), or the absolute path if `ancestor` is -1.
+	 */
+	QString relativePath(int index, int ancestor) const;
+
+	/*!
+	 * @brief Lists the paths of all items below `index`, relative to `index`
+	 * (with leading slash).
+	 */
+	QStringList enumeratePaths(int index) const;
+
+private:
+	typedef QPair<int, int> ChildKey; // Parent entry and segment ID
+
+	int internSegment(const QString &name);
+	int findSegment(const QStringRef &name) const;
+	int findChild(int parent, const QStringRef &name) const;
+	void enumeratePaths(int index, int prefixLength, QStringList &paths) const;
+
+	QMultiHash<uint, int> mSegmentIds; // Segment IDs by hash of the name
+	QVector<QString> mSegments;
+	QVector<Entry> mEntries;
+	QVector<int> mFreeEntries;
+	QHash<ChildKey, int> mChildren;
+	QHash<QString, int> mPaths;
+	QHash<const VBusItem *, int> mItems;
+	QHash<const VBusNode *, int> mNodes;
+};
+
+#endif // V_BUS_PATH_INDEX_H
@@ -0,0 +1,118 @@
+#include <QDBusMessage>
+#include <QDBusMetaType>
+#include <QDBusVirtualObject>
+#include <QsLog.h>
+#include <QStringList>
+#include "v_bus_virtual_object_store.h"
+
+class VBusVirtualObject : public QDBusVirtualObject
+{
+public:
+	explicit VBusVirtualObject(VBusVirtualObjectStore *store) :
+		QDBusVirtualObject(store),
+		mStore(store)
+	{
+	}
+
+	virtual QString introspect(const QString &path) const
+	{
+		return mStore->introspect(path);
+	}
+
+	virtual bool handleMessage(const QDBusMessage &message,
+							   const QDBusConnection &connection)
+	{
+		return mStore->handleMessage(message, connection);
+	}
+
+private:
+	VBusVirtualObjectStore *mStore;
+};
+
+VBusVirtualObjectStore::VBusVirtualObjectStore(const QDBusConnection &connection,
+											   QObject *parent) :
+	VBusItemStore(parent),
+	mConnection(connection),
+	mObject(new VBusVirtualObject(this))
+{
+	qDBusRegisterMetaType<VBusItemChanges>();
+	mRegistered = mConnection.registerVirtualObject("/", mObject, QDBusConnection::SubPath);
+	if (!mRegistered)
+		QLOG_ERROR() << "VBusVirtualObjectStore: could not register the root object";
+}
+
+VBusVirtualObjectStore::~VBusVirtualObjectStore()
+{
+	if (mRegistered)
+		mConnection.unregisterObject("/", QDBusConnection::UnregisterTree);
+}
+
+bool VBusVirtualObjectStore::registerService(const QString &name)
+{
+	return mConnection.registerService(name);
+}
+
+bool VBusVirtualObjectStore::unregisterService(const QString &name)
+{
+	return mConnection.unregisterService(name);
+}
+
+QString VBusVirtualObjectStore::introspect(const QString &path) const
+{
+	QString xml = interfaceXml(path);
+	if (xml.isEmpty() || !isNode(path))
+		return xml;
+	foreach (const QString &name, childNames(path))
+		xml += "  <node name=\"" + name + "\"/>\n";
+	return xml;
+}
+
+bool VBusVirtualObjectStore::handleMessage(const QDBusMessage &message,
+										   const QDBusConnection &connection)
+{
+	if (message.type() != QDBusMessage::MethodCallMessage)
+		return false;
+	if (!message.interface().isEmpty() && message.interface() != interfaceName())
+		return false;
+	QString path = message.path();
+	QString member = message.member();
+	QDBusMessage reply;
+	int id = findItem(path);
+	if (id != -1) {
+		if (member == "GetValue") {
+			reply = message.createReply(QVariant::fromValue(QDBusVariant(value(id))));
+		} else if (member == "GetText") {
+			reply = message.createReply(text(id));
+		} else if (member == "SetValue" && message.arguments().size() == 1) {
+			setValue(id, qvariant_cast<QDBusVariant>(message.arguments().first()).variant());
+			reply = message.createReply(0);
+		}
+	} else if (isNode(path)) {
+		if (member == "GetValue")
+			reply = message.createReply(QVariant::fromValue(QDBusVariant(nodeMap(path, false))));
+		else if (member == "GetText")
+			reply = message.createReply(QVariant::fromValue(QDBusVariant(nodeMap(path, true))));
+	} else {
+		return false;
+	}
+	if (reply.type() == QDBusMessage::InvalidMessage)
+		reply = message.createErrorReply(QDBusError::UnknownMethod,
+										 "Unknown method " + member);
+	QDBusConnection(connection).send(reply);
+	return true;
+}
+
+void VBusVirtualObjectStore::sendPropertiesChanged(int id, const QVariantMap &changes)
+{
+	QDBusMessage signal = QDBusMessage::createSignal(path(id), interfaceName(),
+													 "PropertiesChanged");
+	signal << changes;
+	mConnection.send(signal);
+}
+
+void VBusVirtualObjectStore::sendItemsChanged(const VBusItemChanges &changes)
+{
+	QDBusMessage signal = QDBusMessage::createSignal("/", interfaceName(), "ItemsChanged");
+	signal << QVariant::fromValue(changes);
+	mConnection.send(signal);
+}
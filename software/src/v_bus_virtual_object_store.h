@@ -0,0 +1,43 @@
+#ifndef V_BUS_VIRTUAL_OBJECT_STORE_H
+#define V_BUS_VIRTUAL_OBJECT_STORE_H
+
+#include <QDBusConnection>
+#include "v_bus_item_store.h"
+
+class VBusVirtualObject;
+
+/*!
+ * @brief Item store on a QtDBus connection.
+ * A single `QDBusVirtualObject` is registered at "/" with
+ * `QDBusConnection::SubPath`, and handles the calls to all paths of the
+ * service.
+ * Requires Qt 5.1 or later.
+ */
+class VBusVirtualObjectStore : public VBusItemStore
+{
+	Q_OBJECT
+public:
+	VBusVirtualObjectStore(const QDBusConnection &connection, QObject *parent);
+
+	virtual ~VBusVirtualObjectStore();
+
+	virtual bool registerService(const QString &name);
+
+	virtual bool unregisterService(const QString &name);
+
+	QString introspect(const QString &path) const;
+
+	bool handleMessage(const QDBusMessage &message, const QDBusConnection &connection);
+
+protected:
+	virtual void sendPropertiesChanged(int id, const QVariantMap &changes);
+
+	virtual void sendItemsChanged(const VBusItemChanges &changes);
+
+private:
+	QDBusConnection mConnection;
+	VBusVirtualObject *mObject;
+	bool mRegistered;
+};
+
+#endif // V_BUS_VIRTUAL_OBJECT_STORE_H
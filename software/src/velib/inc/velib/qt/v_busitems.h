@@ -17,6 +17,12 @@ public:
 	static void setConnectionType(QDBusConnection::BusType type);
 	static void setDBusAddress(const QString &address);
 
+	static QDBusConnection::BusType connectionType();
+	static QString dbusAddress();
+
+	static void setItemSignalsEnabled(bool enabled);
+	static bool itemSignalsEnabled();
+
 signals:
 
 public slots:
@@ -24,6 +30,7 @@ public slots:
 private:
 	static QDBusConnection::BusType mBusType;
 	static QString mDBusAddress;
+	static bool mItemSignalsEnabled;
 };
 
 #endif
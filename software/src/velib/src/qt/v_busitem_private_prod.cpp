@@ -1,12 +1,19 @@
+#include <velib/qt/v_busitems.h>
 #include "v_busitem_private_prod.h"
 
 VBusItemPrivateProd::VBusItemPrivateProd(VBusItem *parent) :
 	VBusItemPrivate(parent),
 	mAdp(0),
+	mNumber(0),
+	mIsNumber(false),
+	mTextValid(false),
 	mPrecision(-1)
 {
 }
 
+static const QString ValueKey("Value");
+static const QString TextKey("Text");
+
 // value should be produced on the dbus.
 bool VBusItemPrivateProd::qProduce(QDBusConnection& cnx, QString& name, QString& description, QVariant& value,
 								QString& unit, int precision)
@@ -15,7 +22,7 @@ bool VBusItemPrivateProd::qProduce(QDBusConnection& cnx, QString& name, QString&
 		return false;
 
 	mDescription = description;
-	mValue = value;
+	storeValue(value);
 	mUnit = unit;
 	mPrecision = precision;
 
@@ -33,31 +40,51 @@ int VBusItemPrivateProd::qSetValue(const QVariant &value)
 {
 	Q_Q(VBusItem);
 
-	if (mValue == value)
+	// Doubles are compared without going through QVariant.
+	if (value.type() == QVariant::Double) {
+		if (mIsNumber && value.toDouble() == mNumber)
+			return 0;
+	} else if (!mIsNumber && mValue == value) {
 		return 0;
+	}
 
-	mValue = value;
+	storeValue(value);
 	emit q->valueChanged();
 
-	QVariantMap map;
-	map.insert("Value", value);
-	map.insert("Text", qGetText());
-	emit PropertiesChanged(map);
+	if (!VBusItems::itemSignalsEnabled())
+		return 0;
+
+	// The map and its keys are reused, so once the map has been allocated
+	// only the values are replaced.
+	mChanges[ValueKey] = mValue;
+	mChanges[TextKey] = qGetText();
+	emit PropertiesChanged(mChanges);
 
 	return 0;
 }
 
+// The text is only formatted when requested.
 QString VBusItemPrivateProd::qGetText()
 {
-	QString s;
-	if (mPrecision >= 0 && mValue.type() == QVariant::Double) {
-		s.setNum(mValue.toDouble(), 'f', mPrecision);
+	if (mTextValid)
+		return mText;
+	if (mPrecision >= 0 && mIsNumber) {
+		mText.setNum(mNumber, 'f', mPrecision);
 	} else {
-		s = mValue.toString();
+		mText = mValue.toString();
 	}
-	if (!s.isEmpty())
-		s += mUnit;
-	return s;
+	if (!mText.isEmpty())
+		mText += mUnit;
+	mTextValid = true;
+	return mText;
+}
+
+void VBusItemPrivateProd::storeValue(const QVariant &value)
+{
+	mValue = value;
+	mIsNumber = value.type() == QVariant::Double;
+	mNumber = mIsNumber ? value.toDouble() : 0;
+	mTextValid = false;
 }
 
 /*==== DBUS ====*/
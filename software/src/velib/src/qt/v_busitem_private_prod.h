@@ -36,9 +36,16 @@ signals:
 	void PropertiesChanged(const QVariantMap &map);
 
 private:
+	void storeValue(const QVariant &value);
+
 	VBusItemAdaptor* mAdp;
 
 	QVariant mValue;
+	double mNumber;			// mValue, if it is a double
+	bool mIsNumber;
+	QString mText;			// Formatted on demand
+	bool mTextValid;
+	QVariantMap mChanges;	// Reused for PropertiesChanged
 	QString mUnit;
 	QString mDescription;
 	int mPrecision;
@@ -2,6 +2,7 @@
 
 QDBusConnection::BusType VBusItems::mBusType = QDBusConnection::SessionBus;
 QString VBusItems::mDBusAddress = "";
+bool VBusItems::mItemSignalsEnabled = true;
 
 VBusItems::VBusItems(QObject* parent) :
 	QObject(parent)
@@ -34,6 +35,35 @@ void VBusItems::setDBusAddress(const QString &address)
 	}
 }
 
+QDBusConnection::BusType VBusItems::connectionType()
+{
+	return mBusType;
+}
+
+/**
+ * The address set with setDBusAddress, or an empty string if the connection
+ * type is used.
+ */
+QString VBusItems::dbusAddress()
+{
+	return mDBusAddress;
+}
+
+/**
+ * Enable or disable the PropertiesChanged signal sent by each produced item
+ * when its value changes. Disable it when the changes are announced in another
+ * way, for example by a single signal on the root of the service.
+ */
+void VBusItems::setItemSignalsEnabled(bool enabled)
+{
+	mItemSignalsEnabled = enabled;
+}
+
+bool VBusItems::itemSignalsEnabled()
+{
+	return mItemSignalsEnabled;
+}
+
 QDBusConnection &VBusItems::getConnection()
 {
 	static bool isValid;
@@ -0,0 +1,47 @@
+#include <stdlib.h>
+#include "alloc_counter.h"
+
+#ifdef __GLIBC__
+
+// The definitions below replace those of the C library, also for the calls
+// made by Qt and libdbus. They count and forward to the glibc allocator.
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *p, size_t size);
+}
+
+// Per thread, so the D-Bus thread of QtDBus is not counted
+static __thread long tAllocations;
+
+extern "C" void *malloc(size_t size) throw()
+{
+    ++tAllocations;
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size) throw()
+{
+    ++tAllocations;
+    return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *p, size_t size) throw()
+{
+    ++tAllocations;
+    return __libc_realloc(p, size);
+}
+
+long allocationCount()
+{
+    return tAllocations;
+}
+
+#else
+
+long allocationCount()
+{
+    return -1;
+}
+
+#endif
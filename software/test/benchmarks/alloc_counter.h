@@ -0,0 +1,11 @@
+#ifndef ALLOC_COUNTER_H
+#define ALLOC_COUNTER_H
+
+/*!
+ * \brief Returns the number of heap allocations (malloc, calloc and realloc,
+ * which operator new and the Qt containers use) made by the calling thread
+ * so far, or -1 if they are not counted. They are counted with glibc only.
+ */
+long allocationCount();
+
+#endif // ALLOC_COUNTER_H
@@ -0,0 +1,76 @@
+#include <stdio.h>
+#include <QCoreApplication>
+#include <QDBusConnection>
+#include <QElapsedTimer>
+#include <QList>
+#include <velib/qt/v_busitems.h>
+#include "alloc_counter.h"
+#include "bench_source.h"
+#include "dbus_bridge.h"
+
+/*
+ * Measures how the cost of DBusBridge's change dispatch depends on the number
+ * of produced items. Each source object has one property, produced on its own
+ * path. A round changes every item once and then flushes the ItemsChanged
+ * signal, as a poll of a controller does. Also reports the cost of producing
+ * an item, which includes its initialization. The heap allocations per change
+ * include those of building and sending the ItemsChanged signal. As in
+ * dbus-tsmppt, the PropertiesChanged signals of the items are disabled.
+ */
+
+// Total number of changes per measurement
+const int CHANGES = 100000;
+
+static void measure(DBusBridge::ProducerBackend backend, const char *name, int items)
+{
+    DBusBridge::setProducerBackend(backend);
+    // Destroyed after the bridge, which is connected to the sources
+    QObject owner;
+    DBusBridge bridge(QString("com.victronenergy.bench.dispatch_%1_%2").arg(name).arg(items), 0);
+    QList<BenchSource *> sources;
+    for (int i = 0; i < items; ++i)
+        sources.append(new BenchSource(&owner));
+
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < items; ++i)
+        bridge.produce(sources[i], "value", QString("/Bench/%1/Value").arg(i), "V", 2);
+    double produceNs = (double)timer.nsecsElapsed() / items;
+    QCoreApplication::processEvents();
+
+    int rounds = qMax(1, CHANGES / items);
+    double value = 0;
+    long allocations = allocationCount();
+    timer.start();
+    for (int r = 0; r < rounds; ++r) {
+        value += 1;
+        foreach (BenchSource *s, sources)
+            s->setValue(value);
+        QCoreApplication::processEvents();
+    }
+    double changeNs = (double)timer.nsecsElapsed() / (rounds * items);
+    double changeAllocs = (double)(allocationCount() - allocations) / (rounds * items);
+    printf("%-8s %8d %14.0f %14.0f %14.2f\n", name, items, produceNs, changeNs, changeAllocs);
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    VBusItems::setConnectionType(QDBusConnection::SessionBus);
+    VBusItems::setItemSignalsEnabled(false);
+    if (!QDBusConnection::sessionBus().isConnected()) {
+        fprintf(stderr, "No D-Bus session bus, run with dbus-run-session\n");
+        return 1;
+    }
+
+    const int itemCounts[] = { 10, 100, 1000 };
+    printf("%-8s %8s %14s %14s %14s\n", "backend", "items", "ns/produce", "ns/change",
+           "allocs/change");
+    for (unsigned i = 0; i < sizeof(itemCounts) / sizeof(itemCounts[0]); ++i)
+        measure(DBusBridge::ItemObjects, "objects", itemCounts[i]);
+    if (DBusBridge::isProducerBackendSupported(DBusBridge::ItemStore)) {
+        for (unsigned i = 0; i < sizeof(itemCounts) / sizeof(itemCounts[0]); ++i)
+            measure(DBusBridge::ItemStore, "store", itemCounts[i]);
+    }
+    return 0;
+}
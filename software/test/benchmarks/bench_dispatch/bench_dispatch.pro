@@ -0,0 +1,11 @@
+include(../../common.pri)
+include(../bridge.pri)
+
+TARGET = bench_dispatch
+QT -= testlib
+
+INCLUDEPATH += ..
+HEADERS += ../alloc_counter.h \
+           ../bench_source.h
+SOURCES += bench_dispatch.cpp \
+           ../alloc_counter.cpp
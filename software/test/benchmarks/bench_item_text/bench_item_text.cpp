@@ -0,0 +1,158 @@
+#include <stdio.h>
+#include <QCoreApplication>
+#include <QDBusConnection>
+#include <QElapsedTimer>
+#include <velib/qt/v_busitem.h>
+#include <velib/qt/v_busitems.h>
+#include "alloc_counter.h"
+#include "v_bus_virtual_object_store.h"
+
+/*
+ * Measures the cost and the heap allocations of changing a produced double
+ * value, with and without reading its text, for a VBusItem producer and for
+ * an item in the item store. Each is measured with the PropertiesChanged
+ * signal of the item disabled (the default of dbus-tsmppt) and enabled:
+ * - set: a new value, the text is not read (most changes in practice)
+ * - same: the value that is already stored
+ * - set+text: a new value, then the text, formatted once per change
+ * - text: the text of an unchanged value
+ * Times are in ns, allocations are counted per change (see alloc_counter.h).
+ */
+
+const int CHANGES = 1000000;
+
+static volatile int sink;
+
+/*!
+ * \brief Time and allocations per change of one loop of CHANGES changes.
+ */
+class Meter
+{
+public:
+    void start()
+    {
+        mAllocations = allocationCount();
+        mTimer.start();
+    }
+
+    void stop(double &ns, double &allocations)
+    {
+        ns = (double)mTimer.nsecsElapsed() / CHANGES;
+        allocations = (double)(allocationCount() - mAllocations) / CHANGES;
+    }
+
+private:
+    QElapsedTimer mTimer;
+    long mAllocations;
+};
+
+struct Result
+{
+    double setNs;
+    double setAllocs;
+    double sameNs;
+    double sameAllocs;
+    double setTextNs;
+    double setTextAllocs;
+    double textNs;
+    double textAllocs;
+};
+
+static void print(const char *backend, bool itemSignals, const Result &r)
+{
+    printf("%-8s %-4s %9.0f %9.2f %9.0f %9.2f %9.0f %9.2f %9.0f %9.2f\n", backend,
+           itemSignals ? "on" : "off", r.setNs, r.setAllocs, r.sameNs, r.sameAllocs,
+           r.setTextNs, r.setTextAllocs, r.textNs, r.textAllocs);
+}
+
+static void measureItem(QDBusConnection &connection, bool itemSignals)
+{
+    VBusItems::setItemSignalsEnabled(itemSignals);
+    VBusItem item;
+    item.produce(connection, "/Bench/Value", "", 0.0, "V", 2);
+    // Allocates the reused map of PropertiesChanged
+    item.setValue(-1.0);
+    Meter meter;
+    Result r;
+
+    meter.start();
+    for (int i = 0; i < CHANGES; ++i)
+        item.setValue(i * 0.01);
+    meter.stop(r.setNs, r.setAllocs);
+
+    meter.start();
+    for (int i = 0; i < CHANGES; ++i)
+        item.setValue(1.0);
+    meter.stop(r.sameNs, r.sameAllocs);
+
+    int length = 0;
+    meter.start();
+    for (int i = 0; i < CHANGES; ++i) {
+        item.setValue(i * 0.01);
+        length += item.getText().size();
+    }
+    meter.stop(r.setTextNs, r.setTextAllocs);
+
+    meter.start();
+    for (int i = 0; i < CHANGES; ++i)
+        length += item.getText().size();
+    meter.stop(r.textNs, r.textAllocs);
+
+    sink = length;
+    print("objects", itemSignals, r);
+}
+
+static void measureStore(QDBusConnection &connection, bool itemSignals)
+{
+    VBusItems::setItemSignalsEnabled(itemSignals);
+    VBusVirtualObjectStore store(connection, 0);
+    int id = store.addItem("/Bench/Value", 0.0, "V", 2);
+    store.setValue(id, -1.0);
+    Meter meter;
+    Result r;
+
+    meter.start();
+    for (int i = 0; i < CHANGES; ++i)
+        store.setValue(id, i * 0.01);
+    meter.stop(r.setNs, r.setAllocs);
+
+    meter.start();
+    for (int i = 0; i < CHANGES; ++i)
+        store.setValue(id, 1.0);
+    meter.stop(r.sameNs, r.sameAllocs);
+
+    int length = 0;
+    meter.start();
+    for (int i = 0; i < CHANGES; ++i) {
+        store.setValue(id, i * 0.01);
+        length += store.text(id).size();
+    }
+    meter.stop(r.setTextNs, r.setTextAllocs);
+
+    meter.start();
+    for (int i = 0; i < CHANGES; ++i)
+        length += store.text(id).size();
+    meter.stop(r.textNs, r.textAllocs);
+
+    sink = length;
+    print("store", itemSignals, r);
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    VBusItems::setConnectionType(QDBusConnection::SessionBus);
+    QDBusConnection connection = VBusItems::getConnection("bench-item-text");
+    if (!connection.isConnected()) {
+        fprintf(stderr, "No D-Bus session bus, run with dbus-run-session\n");
+        return 1;
+    }
+
+    printf("%-8s %-4s %9s %9s %9s %9s %9s %9s %9s %9s\n", "backend", "sig", "ns/set",
+           "alloc", "ns/same", "alloc", "ns/s+txt", "alloc", "ns/text", "alloc");
+    measureItem(connection, false);
+    measureItem(connection, true);
+    measureStore(connection, false);
+    measureStore(connection, true);
+    return 0;
+}
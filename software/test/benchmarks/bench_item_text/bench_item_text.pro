@@ -0,0 +1,10 @@
+include(../../common.pri)
+include(../bridge.pri)
+
+TARGET = bench_item_text
+QT -= testlib
+
+INCLUDEPATH += ..
+HEADERS += ../alloc_counter.h
+SOURCES += bench_item_text.cpp \
+           ../alloc_counter.cpp
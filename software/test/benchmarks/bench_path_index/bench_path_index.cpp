@@ -0,0 +1,106 @@
+#include <stdio.h>
+#include <QCoreApplication>
+#include <QDBusConnection>
+#include <QElapsedTimer>
+#include <QList>
+#include <QStringList>
+#include <velib/qt/v_busitem.h>
+#include <velib/qt/v_busitems.h>
+#include "v_bus_node.h"
+
+/*
+ * Measures the path lookups of a VBusNode tree (see VBusPathIndex) for 30
+ * (the size of a dbus-tsmppt service) to 10000 items at paths
+ * /Bench/G<group>/I<item>/Value, 10 items per group:
+ * - add: addChild on the root, including the creation of the nodes
+ * - find: findItem on the root with the absolute path
+ * - find rel: findItem on /Bench with the path relative to it
+ * - path: findPath of an item on the root
+ * - enumerate: enumeratePaths on the root, per item listed
+ * The tree does not need a D-Bus connection, the objects are registered on
+ * the session bus if there is one.
+ */
+
+// Lookups per measurement
+const int LOOKUPS = 1000000;
+const int ITEMS_PER_GROUP = 10;
+
+static void deleteTree(QObject *items)
+{
+    // Empty nodes delete themselves later, the root included.
+    delete items;
+    for (int i = 0; i < 8; ++i)
+        QCoreApplication::sendPostedEvents(0, QEvent::DeferredDelete);
+}
+
+static void measure(int itemCount)
+{
+    QDBusConnection connection = VBusItems::getConnection();
+    QObject owner;
+    QObject *items = new QObject();
+    VBusNode *root = new VBusNode(connection, "/", &owner);
+
+    QStringList paths;
+    QStringList relativePaths;
+    QList<VBusItem *> leafs;
+    for (int i = 0; i < itemCount; ++i) {
+        QString relative = QString("/G%1/I%2/Value").arg(i / ITEMS_PER_GROUP)
+                .arg(i % ITEMS_PER_GROUP);
+        relativePaths.append(relative);
+        paths.append("/Bench" + relative);
+        leafs.append(new VBusItem(items));
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < itemCount; ++i)
+        root->addChild(paths[i], leafs[i]);
+    double addNs = (double)timer.nsecsElapsed() / itemCount;
+
+    // Counted, so the lookups are not optimized away
+    int found = 0;
+    timer.start();
+    for (int i = 0; i < LOOKUPS; ++i)
+        found += root->findItem(paths[i % itemCount]) != 0;
+    double findNs = (double)timer.nsecsElapsed() / LOOKUPS;
+
+    VBusNode *bench = root->findNode("/Bench");
+    if (bench == 0) {
+        fprintf(stderr, "Node /Bench not found\n");
+        deleteTree(items);
+        return;
+    }
+    timer.start();
+    for (int i = 0; i < LOOKUPS; ++i)
+        found += bench->findItem(relativePaths[i % itemCount]) != 0;
+    double findRelativeNs = (double)timer.nsecsElapsed() / LOOKUPS;
+
+    timer.start();
+    for (int i = 0; i < LOOKUPS; ++i)
+        found += !root->findPath(leafs[i % itemCount]).isEmpty();
+    double pathNs = (double)timer.nsecsElapsed() / LOOKUPS;
+
+    int rounds = qMax(1, LOOKUPS / 10 / itemCount);
+    timer.start();
+    for (int i = 0; i < rounds; ++i)
+        found += root->enumeratePaths().size();
+    double enumerateNs = (double)timer.nsecsElapsed() / (rounds * itemCount);
+
+    int expected = 3 * LOOKUPS + rounds * itemCount;
+    printf("%8d %10.0f %10.0f %10.0f %10.0f %10.0f%s\n", itemCount, addNs, findNs,
+           findRelativeNs, pathNs, enumerateNs, found == expected ? "" : "  (lookups failed)");
+    deleteTree(items);
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    VBusItems::setConnectionType(QDBusConnection::SessionBus);
+
+    const int itemCounts[] = { 30, 100, 1000, 10000 };
+    printf("%8s %10s %10s %10s %10s %10s\n", "items", "ns/add", "ns/find", "ns/find rel",
+           "ns/path", "ns/enum");
+    for (unsigned i = 0; i < sizeof(itemCounts) / sizeof(itemCounts[0]); ++i)
+        measure(itemCounts[i]);
+    return 0;
+}
@@ -0,0 +1,7 @@
+include(../../common.pri)
+include(../bridge.pri)
+
+TARGET = bench_path_index
+QT -= testlib
+
+SOURCES += bench_path_index.cpp
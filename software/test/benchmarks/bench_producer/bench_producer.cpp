@@ -0,0 +1,153 @@
+#include <stdio.h>
+#include <QCoreApplication>
+#include <QDBusConnection>
+#include <QDBusMessage>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QList>
+#include <QThread>
+#include <velib/qt/v_busitems.h>
+#include "bench_source.h"
+#include "dbus_bridge.h"
+#include "process_stats.h"
+
+/*
+ * Compares the producer backends of DBusBridge: a VBusItem object per path,
+ * the QtDBus item store and the libdbus item store. Each serves a service of
+ * ITEMS paths from this thread, while a client thread calls it over the
+ * session bus:
+ * - value: GetValue round trip of one item
+ * - root: GetValue round trip of "/", which returns all items
+ * - publish: changing all items once and sending ItemsChanged, without client
+ * - B/path: growth of the resident memory per produced path, for a service
+ *   of MEMORY_ITEMS paths
+ * Memory freed by a backend is reused by the next one, so for comparable
+ * memory figures run a single backend per process: bench_producer <backend>.
+ */
+
+const int ITEMS     = 100;
+const int CALLS     = 10000;
+const int ROUNDS    = 1000;
+// Enough paths to outgrow the granularity of the heap
+const int MEMORY_ITEMS = 2000;
+
+class Client : public QThread
+{
+public:
+    Client(const QString &service):
+        valueUs(0),
+        rootUs(0),
+        failures(0),
+        mService(service)
+    {
+    }
+
+    double valueUs;
+    double rootUs;
+    int failures;
+
+protected:
+    virtual void run()
+    {
+        QString name = "bench-client-" + mService;
+        {
+            QDBusConnection bus = QDBusConnection::connectToBus(QDBusConnection::SessionBus, name);
+            valueUs = measure(bus, "/Bench/0/Value");
+            rootUs = measure(bus, "/");
+        }
+        QDBusConnection::disconnectFromBus(name);
+    }
+
+private:
+    double measure(QDBusConnection &bus, const QString &path)
+    {
+        QDBusMessage call = QDBusMessage::createMethodCall(mService, path,
+                                                           "com.victronenergy.BusItem", "GetValue");
+        QElapsedTimer timer;
+        timer.start();
+        for (int i = 0; i < CALLS; ++i) {
+            if (bus.call(call).type() != QDBusMessage::ReplyMessage)
+                ++failures;
+        }
+        return timer.nsecsElapsed() / 1000.0 / CALLS;
+    }
+
+    QString mService;
+};
+
+static double bytesPerPath(const QString &service)
+{
+    QObject owner;
+    for (int i = 0; i < MEMORY_ITEMS; ++i)
+        new BenchSource(&owner);
+    QList<BenchSource *> sources = owner.findChildren<BenchSource *>();
+    long before = residentMemoryKb();
+    DBusBridge bridge(service, 0);
+    for (int i = 0; i < sources.size(); ++i)
+        bridge.produce(sources[i], "value", QString("/Bench/%1/Value").arg(i), "V", 2);
+    bridge.registerService();
+    QCoreApplication::processEvents();
+    long after = residentMemoryKb();
+    if (before < 0 || after < 0)
+        return -1;
+    return (after - before) * 1024.0 / MEMORY_ITEMS;
+}
+
+static void measure(DBusBridge::ProducerBackend backend, const char *name)
+{
+    DBusBridge::setProducerBackend(backend);
+    QString service = QString("com.victronenergy.bench.producer_%1").arg(name);
+    double memory = bytesPerPath(service + "_memory");
+
+    // Destroyed after the bridge, which is connected to the sources
+    QObject owner;
+    DBusBridge bridge(service, 0);
+    QList<BenchSource *> sources;
+    for (int i = 0; i < ITEMS; ++i) {
+        sources.append(new BenchSource(&owner));
+        bridge.produce(sources[i], "value", QString("/Bench/%1/Value").arg(i), "V", 2);
+    }
+    bridge.registerService();
+
+    QElapsedTimer timer;
+    timer.start();
+    for (int r = 0; r < ROUNDS; ++r) {
+        foreach (BenchSource *s, sources)
+            s->setValue(r + 1);
+        QCoreApplication::processEvents();
+    }
+    double publishUs = timer.nsecsElapsed() / 1000.0 / ROUNDS;
+
+    // The calls of the client are answered by the event loop of this thread.
+    Client client(service);
+    QEventLoop loop;
+    QObject::connect(&client, SIGNAL(finished()), &loop, SLOT(quit()));
+    client.start();
+    loop.exec();
+
+    printf("%-8s %10.1f %10.1f %10.1f %10.0f%s\n", name, client.valueUs, client.rootUs,
+           publishUs, memory, client.failures == 0 ? "" : "  (calls failed)");
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    VBusItems::setConnectionType(QDBusConnection::SessionBus);
+    if (!QDBusConnection::sessionBus().isConnected()) {
+        fprintf(stderr, "No D-Bus session bus, run with dbus-run-session\n");
+        return 1;
+    }
+
+    QString only = argc > 1 ? QString(argv[1]) : QString();
+    printf("%d items, %d calls\n", ITEMS, CALLS);
+    printf("%-8s %10s %10s %10s %10s\n", "backend", "us/value", "us/root", "us/publish",
+           "B/path");
+    if (only.isEmpty() || only == "objects")
+        measure(DBusBridge::ItemObjects, "objects");
+    if ((only.isEmpty() || only == "store") &&
+            DBusBridge::isProducerBackendSupported(DBusBridge::ItemStore))
+        measure(DBusBridge::ItemStore, "store");
+    if (only.isEmpty() || only == "libdbus")
+        measure(DBusBridge::LibDBus, "libdbus");
+    return 0;
+}
@@ -0,0 +1,11 @@
+include(../../common.pri)
+include(../bridge.pri)
+
+TARGET = bench_producer
+QT -= testlib
+
+INCLUDEPATH += ..
+HEADERS += ../bench_source.h \
+           $$SRC/process_stats.h
+SOURCES += bench_producer.cpp \
+           $$SRC/process_stats.cpp
@@ -0,0 +1,39 @@
+#ifndef BENCH_SOURCE_H
+#define BENCH_SOURCE_H
+
+#include <QObject>
+
+/*!
+ * \brief A double property with a notify signal, produced on the D-Bus by
+ * the benchmarks.
+ */
+class BenchSource : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(double value READ value WRITE setValue NOTIFY valueChanged)
+public:
+    BenchSource(QObject *parent):
+        QObject(parent),
+        mValue(0)
+    {
+    }
+
+    double value() const
+    {
+        return mValue;
+    }
+
+    void setValue(double v)
+    {
+        mValue = v;
+        emit valueChanged();
+    }
+
+signals:
+    void valueChanged();
+
+private:
+    double mValue;
+};
+
+#endif // BENCH_SOURCE_H
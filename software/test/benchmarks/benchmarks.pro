@@ -0,0 +1,7 @@
+# Plain executables printing their timings, run them with a D-Bus session
+# bus, for example `dbus-run-session ./bench_dispatch/bench_dispatch`.
+TEMPLATE = subdirs
+SUBDIRS = bench_dispatch \
+          bench_item_text \
+          bench_path_index \
+          bench_producer
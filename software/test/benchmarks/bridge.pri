@@ -0,0 +1,32 @@
+# D-Bus side of dbus-tsmppt: DBusBridge and the producer backends.
+
+HEADERS += $$SRC/dbus_bridge.h \
+           $$SRC/publish_policy.h \
+           $$SRC/v_bus_item_store.h \
+           $$SRC/v_bus_libdbus_store.h \
+           $$SRC/v_bus_node.h \
+           $$SRC/v_bus_path_index.h \
+           $$SRC/v_bus_virtual_object_store.h \
+           $$SRC/velib/src/qt/v_busitem_adaptor.h \
+           $$SRC/velib/src/qt/v_busitem_private_cons.h \
+           $$SRC/velib/src/qt/v_busitem_private_prod.h \
+           $$SRC/velib/src/qt/v_busitem_private.h \
+           $$SRC/velib/src/qt/v_busitem_proxy.h \
+           $$SRC/velib/inc/velib/qt/v_busitem.h \
+           $$SRC/velib/inc/velib/qt/v_busitems.h
+
+SOURCES += $$SRC/dbus_bridge.cpp \
+           $$SRC/publish_policy.cpp \
+           $$SRC/v_bus_item_store.cpp \
+           $$SRC/v_bus_libdbus_store.cpp \
+           $$SRC/v_bus_node.cpp \
+           $$SRC/v_bus_path_index.cpp \
+           $$SRC/v_bus_virtual_object_store.cpp \
+           $$SRC/velib/src/qt/v_busitem.cpp \
+           $$SRC/velib/src/qt/v_busitems.cpp \
+           $$SRC/velib/src/qt/v_busitem_adaptor.cpp \
+           $$SRC/velib/src/qt/v_busitem_private_cons.cpp \
+           $$SRC/velib/src/qt/v_busitem_private_prod.cpp \
+           $$SRC/velib/src/qt/v_busitem_proxy.cpp
+
+DEFINES += VBUS_VIRTUAL_OBJECT_STORE
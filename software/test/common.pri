@@ -0,0 +1,26 @@
+# Settings shared by the tests and benchmarks. Each test builds the sources of
+# dbus-tsmppt it needs from ../src.
+
+lessThan(QT_MAJOR_VERSION, 5): error("The tests require Qt 5")
+
+QT += core network dbus testlib
+QT -= gui
+
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+DEFINES += VERSION=\\\"test\\\"
+
+PKGCONFIG += dbus-1
+CONFIG += link_pkgconfig
+
+SRC = $$PWD/../src
+
+include($$PWD/../ext/qslog/QsLog.pri)
+
+INCLUDEPATH += \
+               $$PWD/../ext/qslog \
+               $$SRC/velib/inc \
+               $$SRC
+
+QMAKE_CXXFLAGS += --std=c++11
@@ -0,0 +1,132 @@
+#include <QHostAddress>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include "fake_modbus_server.h"
+
+const int MBAP_HEADER_SIZE          = 7;
+const quint8 FC_READ_INPUT_REGISTERS = 0x04;
+const quint8 FC_EXCEPTION_FLAG       = 0x80;
+const quint8 EX_ILLEGAL_FUNCTION     = 0x01;
+const quint8 EX_ILLEGAL_ADDRESS      = 0x02;
+
+static inline quint16 getWord(const char *p)
+{
+    return (quint16)(((uchar)p[0] << 8) | (uchar)p[1]);
+}
+
+static inline void appendWord(QByteArray &a, quint16 v)
+{
+    a.append((char)(v >> 8));
+    a.append((char)(v & 0xff));
+}
+
+FakeModbusServer::FakeModbusServer(QObject *parent):
+    QObject(parent),
+    mServer(new QTcpServer(this)),
+    mRegisters(0x10000, 0),
+    mPort(0),
+    mRequests(0)
+{
+    connect(mServer, SIGNAL(newConnection()), this, SLOT(onNewConnection()));
+}
+
+bool FakeModbusServer::listen()
+{
+    if (mServer->isListening())
+        return true;
+    // QTcpServer sets SO_REUSEADDR, so the port can be reopened right away.
+    if (!mServer->listen(QHostAddress::LocalHost, mPort))
+        return false;
+    mPort = mServer->serverPort();
+    return true;
+}
+
+void FakeModbusServer::stop()
+{
+    mServer->close();
+    QList<QTcpSocket *> sockets = mBuffers.keys();
+    mBuffers.clear();
+    foreach (QTcpSocket *socket, sockets) {
+        socket->disconnect(this);
+        socket->abort();
+        socket->deleteLater();
+    }
+}
+
+quint16 FakeModbusServer::port() const
+{
+    return mPort;
+}
+
+void FakeModbusServer::setRegister(int address, quint16 value)
+{
+    mRegisters[address] = value;
+}
+
+int FakeModbusServer::requestCount() const
+{
+    return mRequests;
+}
+
+void FakeModbusServer::onNewConnection()
+{
+    while (mServer->hasPendingConnections()) {
+        QTcpSocket *socket = mServer->nextPendingConnection();
+        mBuffers.insert(socket, QByteArray());
+        connect(socket, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
+        connect(socket, SIGNAL(disconnected()), this, SLOT(onDisconnected()));
+    }
+}
+
+void FakeModbusServer::onReadyRead()
+{
+    QTcpSocket *socket = static_cast<QTcpSocket *>(sender());
+    QByteArray &buffer = mBuffers[socket];
+    buffer.append(socket->readAll());
+    while (buffer.size() >= MBAP_HEADER_SIZE) {
+        int frameSize = 6 + getWord(buffer.constData() + 4);
+        if (buffer.size() < frameSize)
+            break;
+        QByteArray frame = buffer.left(frameSize);
+        buffer.remove(0, frameSize);
+        processFrame(socket, frame);
+    }
+}
+
+void FakeModbusServer::onDisconnected()
+{
+    QTcpSocket *socket = static_cast<QTcpSocket *>(sender());
+    mBuffers.remove(socket);
+    socket->deleteLater();
+}
+
+void FakeModbusServer::processFrame(QTcpSocket *socket, const QByteArray &frame)
+{
+    const char *p = frame.constData();
+    quint8 function = frame.size() > MBAP_HEADER_SIZE ? (quint8)p[7] : 0;
+    QByteArray pdu;
+    if (function != FC_READ_INPUT_REGISTERS || frame.size() != MBAP_HEADER_SIZE + 5) {
+        pdu.append((char)(function | FC_EXCEPTION_FLAG));
+        pdu.append((char)EX_ILLEGAL_FUNCTION);
+    } else {
+        int address = getWord(p + 8);
+        int count = getWord(p + 10);
+        if (count < 1 || count > 125 || address + count > mRegisters.size()) {
+            pdu.append((char)(function | FC_EXCEPTION_FLAG));
+            pdu.append((char)EX_ILLEGAL_ADDRESS);
+        } else {
+            pdu.append((char)function);
+            pdu.append((char)(2 * count));
+            for (int i = 0; i < count; ++i)
+                appendWord(pdu, mRegisters[address + i]);
+        }
+    }
+    QByteArray reply;
+    // Transaction and protocol ID are copied from the request
+    reply.append(frame.left(4));
+    appendWord(reply, 1 + pdu.size());
+    reply.append(p[6]);
+    reply.append(pdu);
+    socket->write(reply);
+    ++mRequests;
+}
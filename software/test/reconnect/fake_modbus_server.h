@@ -0,0 +1,56 @@
+#ifndef FAKE_MODBUS_SERVER_H
+#define FAKE_MODBUS_SERVER_H
+
+#include <QHash>
+#include <QObject>
+#include <QVector>
+
+class QTcpServer;
+class QTcpSocket;
+
+/*!
+ * \brief Minimal Modbus-TCP server standing in for a charge controller.
+ * Answers Read Input Registers (function 0x04) requests for any unit from a
+ * table of 65536 registers, all other functions with exception 1 (illegal
+ * function). `stop` closes the listening socket and drops all connections,
+ * as a power cycled gateway does; `listen` afterwards reopens the same port.
+ */
+class FakeModbusServer : public QObject
+{
+    Q_OBJECT
+public:
+    FakeModbusServer(QObject *parent = 0);
+
+    /*!
+     * \brief Starts accepting connections on 127.0.0.1. The first call picks
+     * a free port, later calls reuse it.
+     */
+    bool listen();
+
+    void stop();
+
+    quint16 port() const;
+
+    void setRegister(int address, quint16 value);
+
+    /*!
+     * \brief Number of requests answered since the server was created.
+     */
+    int requestCount() const;
+
+private slots:
+    void onNewConnection();
+    void onReadyRead();
+    void onDisconnected();
+
+private:
+    void processFrame(QTcpSocket *socket, const QByteArray &frame);
+
+    QTcpServer *mServer;
+    QHash<QTcpSocket *, QByteArray> mBuffers;
+    QVector<quint16> mRegisters;
+    quint16 mPort;
+    int mRequests;
+};
+
+#endif // FAKE_MODBUS_SERVER_H
@@ -0,0 +1,68 @@
+include(../common.pri)
+
+TARGET = tst_reconnect
+CONFIG += testcase
+
+HEADERS += fake_modbus_server.h \
+           $$SRC/adaptive_poll_policy.h \
+           $$SRC/circuit_breaker.h \
+           $$SRC/dbus_bridge.h \
+           $$SRC/dbus_tsmppt_bridge.h \
+           $$SRC/host_resolver.h \
+           $$SRC/modbus_gateway.h \
+           $$SRC/modbus_tcp_client.h \
+           $$SRC/modbus_unit.h \
+           $$SRC/publish_policy.h \
+           $$SRC/reconnect_backoff.h \
+           $$SRC/register_planner.h \
+           $$SRC/register_scheduler.h \
+           $$SRC/rtt_estimator.h \
+           $$SRC/snapshot_slot.h \
+           $$SRC/tsmppt_registers.h \
+           $$SRC/tsmppt.h \
+           $$SRC/tsmppt_acquisition.h \
+           $$SRC/tsmppt_cache.h \
+           $$SRC/v_bus_item_store.h \
+           $$SRC/v_bus_libdbus_store.h \
+           $$SRC/v_bus_node.h \
+           $$SRC/v_bus_path_index.h \
+           $$SRC/v_bus_virtual_object_store.h \
+           $$SRC/velib/src/qt/v_busitem_adaptor.h \
+           $$SRC/velib/src/qt/v_busitem_private_cons.h \
+           $$SRC/velib/src/qt/v_busitem_private_prod.h \
+           $$SRC/velib/src/qt/v_busitem_private.h \
+           $$SRC/velib/src/qt/v_busitem_proxy.h \
+           $$SRC/velib/inc/velib/qt/v_busitem.h \
+           $$SRC/velib/inc/velib/qt/v_busitems.h
+
+SOURCES += fake_modbus_server.cpp \
+           tst_reconnect.cpp \
+           $$SRC/tsmppt.cpp \
+           $$SRC/tsmppt_acquisition.cpp \
+           $$SRC/tsmppt_cache.cpp \
+           $$SRC/host_resolver.cpp \
+           $$SRC/modbus_gateway.cpp \
+           $$SRC/modbus_tcp_client.cpp \
+           $$SRC/modbus_unit.cpp \
+           $$SRC/publish_policy.cpp \
+           $$SRC/reconnect_backoff.cpp \
+           $$SRC/circuit_breaker.cpp \
+           $$SRC/adaptive_poll_policy.cpp \
+           $$SRC/register_planner.cpp \
+           $$SRC/register_scheduler.cpp \
+           $$SRC/rtt_estimator.cpp \
+           $$SRC/dbus_tsmppt_bridge.cpp \
+           $$SRC/dbus_bridge.cpp \
+           $$SRC/v_bus_item_store.cpp \
+           $$SRC/v_bus_libdbus_store.cpp \
+           $$SRC/v_bus_node.cpp \
+           $$SRC/v_bus_path_index.cpp \
+           $$SRC/v_bus_virtual_object_store.cpp \
+           $$SRC/velib/src/qt/v_busitem.cpp \
+           $$SRC/velib/src/qt/v_busitems.cpp \
+           $$SRC/velib/src/qt/v_busitem_adaptor.cpp \
+           $$SRC/velib/src/qt/v_busitem_private_cons.cpp \
+           $$SRC/velib/src/qt/v_busitem_private_prod.cpp \
+           $$SRC/velib/src/qt/v_busitem_proxy.cpp
+
+DEFINES += VBUS_VIRTUAL_OBJECT_STORE
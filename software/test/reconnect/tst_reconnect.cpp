@@ -0,0 +1,271 @@
+#include <QCoreApplication>
+#include <QDBusArgument>
+#include <QDBusConnection>
+#include <QDBusConnectionInterface>
+#include <QDBusMessage>
+#include <QDBusVariant>
+#include <QElapsedTimer>
+#include <QSignalSpy>
+#include <QStringList>
+#include <QTemporaryDir>
+#include <QtTest>
+#include <velib/qt/v_busitems.h>
+#include "dbus_tsmppt_bridge.h"
+#include "fake_modbus_server.h"
+#include "tsmppt.h"
+#include "tsmppt_cache.h"
+#include "tsmppt_registers.h"
+#include "v_bus_node.h"
+
+Q_DECLARE_METATYPE(QList<int>)
+
+const char SERVICE_NAME[]       = "com.victronenergy.solarcharger.tsmppt_test";
+const char BUS_ITEM_INTERFACE[] = "com.victronenergy.BusItem";
+
+const int POLL_INTERVAL_MS  = 1000;
+const int CONNECT_MS        = 10000;
+// A refused connect fails the next poll right away, a dropped connection
+// within the retry budget.
+const int LOSS_MS           = 15000;
+// Longest reconnect delay of TsmpptAcquisition (RECONNECT_MAX_MS)
+const int RECONNECT_CEILING_MS = 60000;
+// Long enough for at least two failed reconnect attempts
+const int DOWN_MS           = 2500;
+// Time to wait for duplicate announcements
+const int SETTLE_MS         = 1500;
+
+// Identity of the fake controller
+const int REG_V_PU          = 0;
+const int REG_I_PU          = 2;
+const int REG_VER_SW        = 4;
+const int REG_ESERIAL       = 57536;
+const int REG_EMODEL        = 57548;
+const int REG_EHW_VERSION   = 57549;
+
+/*!
+ * \brief Checks that a lost Modbus connection keeps the D-Bus service
+ * registered: the service name does not change owner, the loss is reported
+ * once, only the measured values become invalid, and the reconnect is
+ * announced in a single ItemsChanged signal. Reports the recovery time.
+ */
+class TestReconnect : public QObject
+{
+    Q_OBJECT
+public slots:
+    void onItemsChanged(const QDBusMessage &message);
+    void onNameOwnerChanged(const QString &name, const QString &oldOwner,
+                            const QString &newOwner);
+
+private slots:
+    void initTestCase();
+    void recoversAfterGatewayRestart();
+    void cleanupTestCase();
+
+private:
+    struct Announcement
+    {
+        qint64 ms;
+        VBusItemChanges changes;
+    };
+
+    static bool isInvalid(const QVariant &value);
+    static QStringList measuredPaths();
+    QVariant getValue(const QString &path);
+    QList<Announcement> announcements(const QString &path, qint64 sinceMs) const;
+
+    QTemporaryDir mCacheDir;
+    FakeModbusServer *mServer;
+    DBusTsmpptBridge *mBridge;
+    Tsmppt *mTsmppt;
+    QList<Announcement> mAnnouncements;
+    QList<qint64> mOwnerChanges; // Times of NameOwnerChanged for SERVICE_NAME
+    QElapsedTimer mClock;
+};
+
+void TestReconnect::initTestCase()
+{
+    mBridge = 0;
+    QVERIFY(mCacheDir.isValid());
+    TsmpptCache::setFileName(mCacheDir.path() + "/cache.ini");
+
+    VBusItems::setConnectionType(QDBusConnection::SessionBus);
+    QDBusConnection bus = QDBusConnection::sessionBus();
+    if (!bus.isConnected())
+        QSKIP("No D-Bus session bus, run the test with dbus-run-session");
+    QVERIFY(bus.connect(QString(), "/", BUS_ITEM_INTERFACE, "ItemsChanged",
+                        this, SLOT(onItemsChanged(QDBusMessage))));
+    QVERIFY(bus.connect("org.freedesktop.DBus", "/org/freedesktop/DBus", "org.freedesktop.DBus",
+                        "NameOwnerChanged", this,
+                        SLOT(onNameOwnerChanged(QString,QString,QString))));
+    mClock.start();
+
+    mServer = new FakeModbusServer(this);
+    mServer->setRegister(REG_V_PU, 180);
+    mServer->setRegister(REG_I_PU, 80);
+    mServer->setRegister(REG_VER_SW, 0x0102);
+    // Serial number 12345678, two ASCII digits per register, low byte first
+    mServer->setRegister(REG_ESERIAL, 0x3231);
+    mServer->setRegister(REG_ESERIAL + 1, 0x3433);
+    mServer->setRegister(REG_ESERIAL + 2, 0x3635);
+    mServer->setRegister(REG_ESERIAL + 3, 0x3837);
+    mServer->setRegister(REG_EMODEL, 1);
+    mServer->setRegister(REG_EHW_VERSION, 0x0103);
+    for (int i = 0; i < RegisterCount; ++i)
+        mServer->setRegister(RegisterMap[i].address, 1000 + i);
+    mServer->setRegister(RegisterMap[RegChargeState].address, 5);
+    QVERIFY(mServer->listen());
+}
+
+void TestReconnect::recoversAfterGatewayRestart()
+{
+    mTsmppt = new Tsmppt("127.0.0.1", mServer->port(), POLL_INTERVAL_MS, 1);
+    QSignalSpy connectedSpy(mTsmppt, SIGNAL(tsmpptConnected()));
+    QSignalSpy lostSpy(mTsmppt, SIGNAL(connectionLost()));
+    // Registers the service and starts polling, owns mTsmppt
+    mBridge = new DBusTsmpptBridge(mTsmppt, SERVICE_NAME, 0);
+
+    QTRY_COMPARE_WITH_TIMEOUT(connectedSpy.count(), 1, CONNECT_MS);
+    QTRY_VERIFY_WITH_TIMEOUT(!isInvalid(getValue("/Dc/0/Voltage")), CONNECT_MS);
+    QCOMPARE(getValue("/Connected").toInt(), 1);
+    QCOMPARE(getValue("/Serial").toString(), QString("12345678"));
+    QVERIFY(QDBusConnection::sessionBus().interface()->isServiceRegistered(SERVICE_NAME).value());
+
+    // The gateway goes down
+    qint64 lostMs = mClock.elapsed();
+    mServer->stop();
+    QTRY_COMPARE_WITH_TIMEOUT(lostSpy.count(), 1, LOSS_MS);
+    QTRY_COMPARE_WITH_TIMEOUT(getValue("/Connected").toInt(), 0, CONNECT_MS);
+
+    // Only the measured paths are invalid, the identity is kept.
+    foreach (const QString &path, measuredPaths())
+        QVERIFY2(isInvalid(getValue(path)), qPrintable(path));
+    QCOMPARE(getValue("/Serial").toString(), QString("12345678"));
+    QCOMPARE(getValue("/ProductName").toString(), QString("TriStar MPPT 60"));
+    QCOMPARE(getValue("/FirmwareVersion").toInt(), 102);
+    QCOMPARE(getValue("/HardwareVersion").toString(), QString("1.3"));
+    QCOMPARE(getValue("/ProductId").toInt(), 0xABCD);
+    QList<Announcement> lost = announcements("/Connected", lostMs);
+    QCOMPARE(lost.size(), 1);
+    QCOMPARE(lost.first().changes.value("/Connected").value("Value").toInt(), 0);
+    for (VBusItemChanges::const_iterator it = lost.first().changes.constBegin();
+         it != lost.first().changes.constEnd(); ++it) {
+        bool invalid = isInvalid(it.value().value("Value"));
+        QVERIFY2(invalid == measuredPaths().contains(it.key()), qPrintable(it.key()));
+    }
+
+    // Failed reconnect attempts are not reported again
+    QTest::qWait(DOWN_MS);
+    QCOMPARE(lostSpy.count(), 1);
+    QCOMPARE(connectedSpy.count(), 1);
+
+    // The gateway comes back on the same port
+    QElapsedTimer recovery;
+    recovery.start();
+    qint64 restoredMs = mClock.elapsed();
+    QVERIFY(mServer->listen());
+    QTRY_COMPARE_WITH_TIMEOUT(connectedSpy.count(), 2, RECONNECT_CEILING_MS + CONNECT_MS);
+    qint64 recoveryMs = recovery.elapsed();
+    qDebug() << "Reconnected" << recoveryMs << "ms after the gateway came back, outage"
+             << restoredMs - lostMs << "ms";
+    QVERIFY2(recoveryMs <= RECONNECT_CEILING_MS,
+             qPrintable(QString("Reconnected after %1 ms").arg(recoveryMs)));
+    QCOMPARE(lostSpy.count(), 1);
+
+    // The recovery is announced once, together with the restored values.
+    QTRY_COMPARE_WITH_TIMEOUT(announcements("/Connected", restoredMs).size(), 1, CONNECT_MS);
+    QTest::qWait(SETTLE_MS);
+    QList<Announcement> restored = announcements("/Connected", restoredMs);
+    QCOMPARE(restored.size(), 1);
+    const VBusItemChanges &changes = restored.first().changes;
+    QCOMPARE(changes.value("/Connected").value("Value").toInt(), 1);
+    foreach (const QString &path, measuredPaths()) {
+        QVERIFY2(changes.contains(path), qPrintable(path));
+        QVERIFY2(!isInvalid(changes.value(path).value("Value")), qPrintable(path));
+    }
+    QCOMPARE(lostSpy.count(), 1);
+
+    // The service name was owned throughout the outage and the recovery.
+    foreach (qint64 ms, mOwnerChanges)
+        QVERIFY2(ms < lostMs, qPrintable(QString("Owner of %1 changed after %2 ms")
+                                         .arg(SERVICE_NAME).arg(ms - lostMs)));
+    QVERIFY(QDBusConnection::sessionBus().interface()->isServiceRegistered(SERVICE_NAME).value());
+}
+
+void TestReconnect::cleanupTestCase()
+{
+    // Stops the acquisition and deletes mTsmppt
+    delete mBridge;
+}
+
+void TestReconnect::onItemsChanged(const QDBusMessage &message)
+{
+    if (message.arguments().isEmpty())
+        return;
+    Announcement a;
+    a.ms = mClock.elapsed();
+    a.changes = qdbus_cast<VBusItemChanges>(message.arguments().first());
+    mAnnouncements.append(a);
+}
+
+void TestReconnect::onNameOwnerChanged(const QString &name, const QString &oldOwner,
+                                       const QString &newOwner)
+{
+    Q_UNUSED(oldOwner)
+    Q_UNUSED(newOwner)
+    if (name == SERVICE_NAME)
+        mOwnerChanges.append(mClock.elapsed());
+}
+
+bool TestReconnect::isInvalid(const QVariant &value)
+{
+    // Invalid values are sent as an empty array of integers.
+    if (value.userType() == qMetaTypeId<QDBusArgument>())
+        return value.value<QDBusArgument>().currentSignature() == "ai";
+    if (value.userType() == qMetaTypeId<QList<int> >())
+        return value.value<QList<int> >().isEmpty();
+    return false;
+}
+
+QStringList TestReconnect::measuredPaths()
+{
+    QStringList paths;
+    for (int i = 0; i < RegisterCount; ++i) {
+        if (RegisterMap[i].path != 0)
+            paths.append(RegisterMap[i].path);
+    }
+    paths << "/Yield/User" << "/Yield/System" << "/History/Daily/0/TimeInBulk";
+    return paths;
+}
+
+QVariant TestReconnect::getValue(const QString &path)
+{
+    QDBusMessage call = QDBusMessage::createMethodCall(SERVICE_NAME, path, BUS_ITEM_INTERFACE,
+                                                       "GetValue");
+    // The service runs in this thread, keep its event loop running.
+    QDBusMessage reply = QDBusConnection::sessionBus().call(call, QDBus::BlockWithGui);
+    if (reply.type() != QDBusMessage::ReplyMessage || reply.arguments().isEmpty()) {
+        qWarning() << "GetValue" << path << "failed:" << reply.errorMessage();
+        return QVariant();
+    }
+    return reply.arguments().first().value<QDBusVariant>().variant();
+}
+
+QList<TestReconnect::Announcement> TestReconnect::announcements(const QString &path,
+                                                                qint64 sinceMs) const
+{
+    QList<Announcement> result;
+    foreach (const Announcement &a, mAnnouncements) {
+        if (a.ms >= sinceMs && a.changes.contains(path))
+            result.append(a);
+    }
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    TestReconnect test;
+    return QTest::qExec(&test, argc, argv);
+}
+
+#include "tst_reconnect.moc"
@@ -0,0 +1,5 @@
+# Build with `qmake && make`, run the test with `make check`. The reconnect
+# test and the benchmarks need a D-Bus session bus, for example
+# `dbus-run-session make check`.
+TEMPLATE = subdirs
+SUBDIRS = reconnect benchmarks